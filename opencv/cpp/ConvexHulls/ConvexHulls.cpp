@@ -7,7 +7,14 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include "ContourArena.hpp"
+#include "ContourRaster.hpp"
+#include "MelkmanHull.hpp"
+#include "PackedBinary.hpp"
+#include "ParallelComponents.hpp"
+#include "RectMorphology.hpp"
 #include <iostream>
+#include <new>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -17,29 +24,102 @@ using namespace std;
 Mat src; Mat src_gray;
 int thresh = 100;
 int max_thresh = 255;
+int open_size = 0;
+int max_open = 50;
 RNG rng(12345);
 
-/// Function header
+/// Everything thresh_callback works in, kept from one call to the next: once
+/// the buffers have grown to the image, a call allocates nothing
+struct HullWorkspace
+{
+  tut::PackedBinary threshold_output;
+  Mat mask;
+  tut::RectMorphology morph;
+  tut::PackedContourFinder finder;
+  tut::ContourArena contours, hull;
+  tut::MelkmanHulls hulls;
+  tut::ContourRasterizer raster;
+  Mat drawing;
+};
+HullWorkspace workspace;
+
+/// Heap allocations made by the whole program, Mat buffers included (each
+/// one comes with a header from new); thresh_callback prints its own share.
+/// Counting replaces the global allocator, so it is only compiled in with
+/// COUNT_ALLOCS (cmake -DCOUNT_ALLOCS=ON), for --allocs
+static int heap_allocs = 0;
+
+#ifdef COUNT_ALLOCS
+void* operator new( size_t size )
+{
+  CV_XADD( &heap_allocs, 1 );
+  void* p = malloc( size ? size : 1 );
+  if( !p )
+    { throw std::bad_alloc(); }
+  return p;
+}
+void* operator new[]( size_t size ) { return operator new( size ); }
+void* operator new( size_t size, const std::nothrow_t& ) noexcept
+{
+  CV_XADD( &heap_allocs, 1 );
+  return malloc( size ? size : 1 );
+}
+void* operator new[]( size_t size, const std::nothrow_t& tag ) noexcept { return operator new( size, tag ); }
+void operator delete( void* p ) noexcept { free( p ); }
+void operator delete[]( void* p ) noexcept { free( p ); }
+void operator delete( void* p, size_t ) noexcept { free( p ); }
+void operator delete[]( void* p, size_t ) noexcept { free( p ); }
+void operator delete( void* p, const std::nothrow_t& ) noexcept { free( p ); }
+void operator delete[]( void* p, const std::nothrow_t& ) noexcept { free( p ); }
+#endif
+
+/// Function headers
 void thresh_callback(int, void* );
+void find_hulls();
+int count_allocations( int step );
+int bench_hulls( const Mat& gray, int step );
+int bench_blobs( const Mat& gray, int step );
+bool same_components( const Mat& labels, const vector<tut::ComponentStats>& blobs, const Mat& ref_labels,
+                      const Mat& ref_stats, const Mat& ref_centroids );
 
 /**
  * @function main
  */
-int main( int, char** argv )
+int main( int argc, char** argv )
 {
+  CommandLineParser parser( argc, argv,
+      "{@image |   | input image}"
+      "{bench  |   | time convexHull per contour against the Melkman hulls, over every threshold}"
+      "{allocs |   | run the callback over every threshold twice, without windows, and count its heap allocations}"
+      "{blobs  |   | time findContours + per contour stats (timing only) against connected component labeling, over every threshold}"
+      "{step   | 5 | threshold step for --bench, --allocs and --blobs}" );
+
   /// Load source image and convert it to gray
-  src = imread( argv[1], 1 );
+  src = imread( parser.get<string>( "@image" ), 1 );
+  if( src.empty() )
+  {
+    cerr << "No image supplied ..." << endl;
+    return -1;
+  }
 
   /// Convert image to gray and blur it
   cvtColor( src, src_gray, COLOR_BGR2GRAY );
   blur( src_gray, src_gray, Size(3,3) );
 
+  if( parser.has( "bench" ) )
+    { return bench_hulls( src_gray, max( 1, parser.get<int>( "step" ) ) ); }
+  if( parser.has( "blobs" ) )
+    { return bench_blobs( src_gray, max( 1, parser.get<int>( "step" ) ) ); }
+  if( parser.has( "allocs" ) )
+    { return count_allocations( max( 1, parser.get<int>( "step" ) ) ); }
+
   /// Create Window
   const char* source_window = "Source";
   namedWindow( source_window, WINDOW_AUTOSIZE );
   imshow( source_window, src );
 
   createTrackbar( " Threshold:", "Source", &thresh, max_thresh, thresh_callback );
+  createTrackbar( " Open:", "Source", &open_size, max_open, thresh_callback );
   thresh_callback( 0, 0 );
 
   waitKey(0);
@@ -51,32 +131,268 @@ int main( int, char** argv )
  */
 void thresh_callback(int, void* )
 {
-  Mat src_copy = src.clone();
-  Mat threshold_output;
-  vector<vector<Point> > contours;
-  vector<Vec4i> hierarchy;
+  int allocs = heap_allocs;
+  find_hulls();
+#ifdef COUNT_ALLOCS
+  printf( "%d contours, %d heap allocations\n", workspace.contours.size(), heap_allocs - allocs );
+#else
+  (void)allocs;
+  printf( "%d contours\n", workspace.contours.size() );
+#endif
+
+  /// Show in a window
+  namedWindow( "Hull demo", WINDOW_AUTOSIZE );
+  imshow( "Hull demo", workspace.drawing );
+}
 
-  /// Detect edges using Threshold
-  threshold( src_gray, threshold_output, thresh, 255, THRESH_BINARY );
+/**
+ * @function find_hulls
+ * @brief Threshold, contours, hulls and their drawing, all in the workspace
+ */
+void find_hulls()
+{
+  /// Detect edges using Threshold, packed to one bit per pixel
+  /// (the bits of threshold( src_gray, output, thresh, 255, THRESH_BINARY ))
+  if( open_size > 1 )
+  {
+    /// Opened first with an open_size square, to drop specks and thin
+    /// bridges that would otherwise become contours of their own
+    threshold( src_gray, workspace.mask, thresh, 255, THRESH_BINARY );
+    workspace.morph.apply( workspace.mask, workspace.mask, MORPH_OPEN, Size( open_size, open_size ) );
+    tut::packThreshold( workspace.mask, workspace.threshold_output, 0 );
+  }
+  else
+  { tut::packThreshold( src_gray, workspace.threshold_output, thresh ); }
 
-  /// Find contours
-  findContours( threshold_output, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE, Point(0, 0) );
+  /// Find contours on the packed rows, same contours as
+  /// findContours( output, contours, RETR_LIST, CHAIN_APPROX_SIMPLE )
+  workspace.finder.find( workspace.threshold_output, workspace.contours, true );
 
-  /// Find the convex hull object for each contour
-  vector<vector<Point> >hull( contours.size() );
-  for( size_t i = 0; i < contours.size(); i++ )
-     {   convexHull( Mat(contours[i]), hull[i], false ); }
+  /// Find the convex hull object for each contour, in one walk along each
+  /// and on all threads: the points of convexHull( contours[i], hull[i], false )
+  workspace.hulls.compute( workspace.contours, workspace.hull, false );
 
-  /// Draw contours + hull results
-  Mat drawing = Mat::zeros( threshold_output.size(), CV_8UC3 );
-  for( size_t i = 0; i< contours.size(); i++ )
+  /// Draw contours + hull results, all in one batch on all threads: the
+  /// pixels of drawContours( drawing, contours, i, color ), then the same for
+  /// the hull, contour after contour
+  workspace.drawing.create( src_gray.size(), CV_8UC3 );
+  workspace.drawing = Scalar::all( 0 );
+  workspace.raster.clear();
+  for( int i = 0; i< workspace.contours.size(); i++ )
      {
        Scalar color = Scalar( rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255) );
-       drawContours( drawing, contours, (int)i, color, 1, 8, vector<Vec4i>(), 0, Point() );
-       drawContours( drawing, hull, (int)i, color, 1, 8, vector<Vec4i>(), 0, Point() );
+       workspace.raster.add( workspace.contours, i, color );
+       workspace.raster.add( workspace.hull, i, color );
      }
+  workspace.raster.draw( workspace.drawing );
+}
 
-  /// Show in a window
-  namedWindow( "Hull demo", WINDOW_AUTOSIZE );
-  imshow( "Hull demo", drawing );
+/**
+ * @function count_allocations
+ * @brief Runs find_hulls for every step-th threshold, twice over, and prints the
+ * heap allocations of each pass. The first pass grows the workspace; the second
+ * should make none, apart from any OpenCV's thread pool makes to run parallel_for_
+ */
+int count_allocations( int step )
+{
+#ifndef COUNT_ALLOCS
+  printf( "--allocs needs a build with allocation counting: cmake -DCOUNT_ALLOCS=ON\n" );
+  (void)step;
+  return 1;
+#else
+  for( int pass = 1; pass <= 2; pass++ )
+     {
+       int allocs = heap_allocs, worst = 0;
+       for( thresh = 0; thresh <= max_thresh; thresh += step )
+          {
+            int before = heap_allocs;
+            find_hulls();
+            worst = max( worst, heap_allocs - before );
+          }
+       printf( "pass %d: %d heap allocations, at most %d in one call\n", pass, heap_allocs - allocs, worst );
+     }
+  return 0;
+#endif
+}
+
+/**
+ * @function same_hull
+ * @brief Whether two hulls have the same points in the same order, from any start
+ */
+static bool same_hull( const Point* a, int n, const Point* b, int m )
+{
+  if( n != m )
+    { return false; }
+  if( n == 0 )
+    { return true; }
+  int s = 0;
+  while( s < n && b[s] != a[0] )
+    { s++; }
+  if( s == n )
+    { return false; }
+  for( int j = 0; j < n; j++ )
+     {
+       if( a[j] != b[(s + j) % n] )
+         { return false; }
+     }
+  return true;
+}
+
+/**
+ * @function bench_hulls
+ * @brief Hulls of the contours of every step-th threshold, with convexHull one
+ * contour at a time as before, then with MelkmanHulls; prints both times
+ */
+int bench_hulls( const Mat& gray, int step )
+{
+  tut::ContourArena& contours = workspace.contours;
+  tut::ContourArena& hull = workspace.hull;
+  tut::PackedBinary& bits = workspace.threshold_output;
+  vector<vector<Point> > contour_list;
+  vector<vector<Point> > hull_list;
+  double t_loop = 0, t_melkman = 0;
+  long n_contours = 0, n_points = 0, n_sorted = 0, mismatches = 0;
+
+  for( int t = 0; t <= max_thresh; t += step )
+     {
+       tut::packThreshold( gray, bits, t );
+       workspace.finder.find( bits, contours, true );
+       contours.copyTo( contour_list );
+
+       int64 t0 = getTickCount();
+       hull_list.resize( contour_list.size() );
+       for( size_t i = 0; i < contour_list.size(); i++ )
+          { convexHull( Mat(contour_list[i]), hull_list[i], false ); }
+       int64 t1 = getTickCount();
+       workspace.hulls.compute( contours, hull, false );
+       int64 t2 = getTickCount();
+       t_loop += (t1 - t0) * 1000. / getTickFrequency();
+       t_melkman += (t2 - t1) * 1000. / getTickFrequency();
+
+       for( int i = 0; i < contours.size(); i++ )
+          {
+            const vector<Point>& h = hull_list[i];
+            if( !same_hull( h.empty() ? 0 : &h[0], (int)h.size(), hull.begin( i ), hull.length( i ) ) )
+              { mismatches++; }
+          }
+       n_contours += contours.size();
+       n_points += contours.total();
+       n_sorted += workspace.hulls.sortedCount();
+     }
+
+  printf( "%ld contours, %ld points\n", n_contours, n_points );
+  printf( "convexHull per contour: %8.2f ms\n", t_loop );
+  printf( "Melkman hulls:          %8.2f ms (%.1fx), %ld contours sorted instead\n",
+          t_melkman, t_loop / max( t_melkman, 1e-6 ), n_sorted );
+  printf( "%ld hulls differ\n", mismatches );
+  return mismatches ? 1 : 0;
+}
+
+/**
+ * @function same_components
+ * @brief Whether two labelings have the same components, whatever their
+ * numbers, with the same areas, boxes and centroids
+ */
+bool same_components( const Mat& labels, const vector<tut::ComponentStats>& blobs, const Mat& ref_labels,
+                      const Mat& ref_stats, const Mat& ref_centroids )
+{
+  int n = (int)blobs.size();
+  if( ref_stats.rows != n )
+    { return false; }
+  /// One to one between the numbers, over every pixel
+  vector<int> to_ref( n, -1 ), from_ref( n, -1 );
+  for( int y = 0; y < labels.rows; y++ )
+     {
+       const int* l = labels.ptr<int>(y);
+       const int* r = ref_labels.ptr<int>(y);
+       for( int x = 0; x < labels.cols; x++ )
+          {
+            if( to_ref[l[x]] < 0 && from_ref[r[x]] < 0 )
+              {
+                to_ref[l[x]] = r[x];
+                from_ref[r[x]] = l[x];
+              }
+            else if( to_ref[l[x]] != r[x] )
+              { return false; }
+          }
+     }
+  for( int i = 0; i < n; i++ )
+     {
+       if( to_ref[i] < 0 )
+         { return false; }
+       const int* r = ref_stats.ptr<int>(to_ref[i]);
+       const double* c = ref_centroids.ptr<double>(to_ref[i]);
+       if( blobs[i].area != r[CC_STAT_AREA] ||
+           blobs[i].bbox != Rect( r[CC_STAT_LEFT], r[CC_STAT_TOP], r[CC_STAT_WIDTH], r[CC_STAT_HEIGHT] ) ||
+           fabs( blobs[i].centroid.x - c[0] ) >= 1e-6 || fabs( blobs[i].centroid.y - c[1] ) >= 1e-6 )
+         { return false; }
+     }
+  return true;
+}
+
+/**
+ * @function bench_blobs
+ * @brief Blob boxes and centroids of every step-th threshold: with
+ * findContours and contourArea, boundingRect and moments per outer border
+ * (RETR_CCOMP, so blobs inside holes count too), then with the parallel
+ * labeler, checked against connectedComponentsWithStats. The contour areas
+ * are polygon areas, not pixel counts, so the contour path is a timing
+ * baseline only.
+ */
+int bench_blobs( const Mat& gray, int step )
+{
+  tut::ParallelComponentLabeler labeler;
+  vector<tut::ComponentStats> blobs, contour_stats;
+  vector<vector<Point> > contour_list;
+  vector<Vec4i> contour_hierarchy;
+  Mat mask, traced, labels, ref_labels, ref_stats, ref_centroids;
+  double t_contours = 0, t_labels = 0, t_ref = 0;
+  long n_contours = 0, n_blobs = 0, mismatches = 0;
+  double f = 1000. / getTickFrequency();
+
+  for( int t = 0; t <= max_thresh; t += step )
+     {
+       threshold( gray, mask, t, 255, THRESH_BINARY );
+
+       /// Contours first, then their statistics
+       int64 t0 = getTickCount();
+       mask.copyTo( traced );
+       findContours( traced, contour_list, contour_hierarchy, RETR_CCOMP, CHAIN_APPROX_SIMPLE );
+       contour_stats.resize( contour_list.size() );
+       for( size_t i = 0; i < contour_list.size(); i++ )
+          {
+            /// Holes are the second level
+            if( contour_hierarchy[i][3] >= 0 )
+              { continue; }
+            n_contours++;
+            Moments m = moments( contour_list[i] );
+            contour_stats[i].area = (int)contourArea( contour_list[i] );
+            contour_stats[i].bbox = boundingRect( contour_list[i] );
+            contour_stats[i].centroid = m.m00 != 0 ? Point2d( m.m10 / m.m00, m.m01 / m.m00 ) : Point2d();
+          }
+       int64 t1 = getTickCount();
+       int n = labeler.label( mask, labels, blobs );
+       int64 t2 = getTickCount();
+       int ref_n = connectedComponentsWithStats( mask, ref_labels, ref_stats, ref_centroids, 8, CV_32S );
+       int64 t3 = getTickCount();
+       t_contours += (t1 - t0) * f;
+       t_labels += (t2 - t1) * f;
+       t_ref += (t3 - t2) * f;
+       n_blobs += n - 1;
+
+       /// Same components and statistics as connectedComponentsWithStats,
+       /// numbered in another order
+       if( n != ref_n || !same_components( labels, blobs, ref_labels, ref_stats, ref_centroids ) )
+         {
+           printf( "threshold %d: components or statistics differ from connectedComponentsWithStats\n", t );
+           mismatches++;
+         }
+     }
+
+  printf( "%ld outer borders, %ld components\n", n_contours, n_blobs );
+  printf( "findContours + contour stats: %8.2f ms (timing only: polygon areas, not pixel counts)\n", t_contours );
+  printf( "parallel labeling + stats:    %8.2f ms (%.1fx)\n", t_labels, t_contours / max( t_labels, 1e-6 ) );
+  printf( "connectedComponentsWithStats: %8.2f ms\n", t_ref );
+  printf( "%ld thresholds differ\n", mismatches );
+  return mismatches ? 1 : 0;
 }
@@ -7,7 +7,13 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include "CannyStages.hpp"
+#include "ContourRaster.hpp"
+#include "ContourSimplify.hpp"
+#include "ParallelContours.hpp"
+#include <fstream>
 #include <iostream>
+#include <map>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -17,18 +23,57 @@ using namespace std;
 Mat src; Mat src_gray;
 int thresh = 100;
 int max_thresh = 255;
+int min_area = 0;
+int max_min_area = 500;
+int approx_eps = 0;
+int max_approx_eps = 20;
 RNG rng(12345);
+tut::ParallelContourFinder finder;
+tut::CannyStages canny;
+tut::ContourArena contours;
+tut::ContourRasterizer raster;
+tut::ContourSimplifier simplifier;
+tut::ContourArena approx;
+vector<tut::ContourStats> stats;
+Mat canny_output;
 
-/// Function header
+/// Function headers
 void thresh_callback(int, void* );
+int check_contours( const vector<string>& images, int step, double epsilon );
+vector<int> border_key( const vector<Point>& contour, const vector<Vec4i>& hierarchy, int i );
+void reference_dp( const vector<Point>& contour, int start, int end, double epsilon, vector<uchar>& keep );
+void reference_simplify( const vector<Point>& contour, double epsilon, vector<int>& kept );
+bool within_epsilon( const vector<Point>& contour, const vector<int>& kept, double epsilon );
 
 /**
  * @function main
  */
-int main( int, char** argv )
+int main( int argc, char** argv )
 {
+  CommandLineParser parser( argc, argv,
+      "{@image |   | input image}"
+      "{check  |   | compare the parallel contours with findContours on the Canny output of every threshold}"
+      "{corpus |   | text file listing more images for --check, one per line}"
+      "{step   | 5 | threshold step for --check}"
+      "{epsilon| 2 | Douglas-Peucker tolerance for --check, in pixels}" );
+
+  if( parser.has( "check" ) )
+  {
+    vector<string> images;
+    if( !parser.get<string>( "@image" ).empty() )
+      { images.push_back( parser.get<string>( "@image" ) ); }
+    if( parser.has( "corpus" ) )
+    {
+      ifstream list( parser.get<string>( "corpus" ).c_str() );
+      string line;
+      while( getline( list, line ) )
+        { if( !line.empty() ) images.push_back( line ); }
+    }
+    return check_contours( images, max( 1, parser.get<int>( "step" ) ), parser.get<double>( "epsilon" ) );
+  }
+
   /// Load source image
-  src = imread(argv[1]);
+  src = imread( parser.get<string>( "@image" ) );
   if (src.empty())
   {
     cerr << "No image supplied ..." << endl;
@@ -39,12 +84,17 @@ int main( int, char** argv )
   cvtColor( src, src_gray, COLOR_BGR2GRAY );
   blur( src_gray, src_gray, Size(3,3) );
 
+  /// Gradient and non-maximum suppression once; the trackbar only reruns hysteresis
+  canny.setImage( src_gray );
+
   /// Create Window
   const char* source_window = "Source";
   namedWindow( source_window, WINDOW_AUTOSIZE );
   imshow( source_window, src );
 
   createTrackbar( " Canny thresh:", "Source", &thresh, max_thresh, thresh_callback );
+  createTrackbar( " Min area:", "Source", &min_area, max_min_area, thresh_callback );
+  createTrackbar( " Approx eps:", "Source", &approx_eps, max_approx_eps, thresh_callback );
   thresh_callback( 0, 0 );
 
   waitKey(0);
@@ -56,24 +106,372 @@ int main( int, char** argv )
  */
 void thresh_callback(int, void* )
 {
-  Mat canny_output;
-  vector<vector<Point> > contours;
-  vector<Vec4i> hierarchy;
+  /// Detect edges using canny, same as Canny( src_gray, canny_output, thresh, thresh*2, 3 )
+  canny.edges( thresh, thresh*2, canny_output );
+  /// Find contours, on all threads: the same contours and hierarchy as
+  /// findContours( canny_output, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE ),
+  /// kept in one arena reused from call to call, with the area, perimeter,
+  /// box and moments of each one
+  int64 t = getTickCount();
+  finder.find( canny_output, contours, true, 0, &stats );
+  printf( "%d contours in %.2f ms\n", (int)contours.size(),
+          (getTickCount() - t) * 1000. / getTickFrequency() );
 
-  /// Detect edges using canny
-  Canny( src_gray, canny_output, thresh, thresh*2, 3 );
-  /// Find contours
-  findContours( canny_output, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE, Point(0, 0) );
+  /// Simplify them, Douglas-Peucker with tolerance approx_eps as approxPolyDP,
+  /// all contours in parallel
+  t = getTickCount();
+  simplifier.simplify( contours, approx, approx_eps );
+  double ms = (getTickCount() - t) * 1000. / getTickFrequency();
+  printf( "simplified %d -> %d points (%.1f%%), %.3f ms per 1k contours\n",
+          contours.total(), approx.total(), 100. * approx.total() / max( 1, contours.total() ),
+          ms * 1000. / max( 1, contours.size() ) );
 
-  /// Draw contours
+  /// Draw the simplified contours (the traced ones at 0), skipping those
+  /// smaller than min_area, 2 pixels wide as drawContours( drawing, contours,
+  /// i, color, 2, 8, hierarchy, 0 ); the batched rasterizer only draws 1 pixel
+  /// wide lines, so it is left to --check
+  const tut::ContourArena& shown = approx_eps ? approx : contours;
+  t = getTickCount();
   Mat drawing = Mat::zeros( canny_output.size(), CV_8UC3 );
-  for( size_t i = 0; i< contours.size(); i++ )
+  for( int i = 0; i< contours.size(); i++ )
      {
+       if( stats[i].area < min_area )
+         { continue; }
        Scalar color = Scalar( rng.uniform(0, 255), rng.uniform(0,255), rng.uniform(0,255) );
-       drawContours( drawing, contours, (int)i, color, 2, 8, hierarchy, 0, Point() );
+       tut::drawContours( drawing, shown, i, color, 2, 8, 0 );
      }
+  printf( "drawn in %.2f ms\n", (getTickCount() - t) * 1000. / getTickFrequency() );
 
   /// Show in a window
   namedWindow( "Contours", WINDOW_AUTOSIZE );
   imshow( "Contours", drawing );
 }
+
+/**
+ * @function reference_dp
+ * @brief Plain recursive Douglas-Peucker on contour[start..end], end == size
+ * standing for contour[0] again: marks the farthest point from the line
+ * start - end, if farther than epsilon, and recurses on both halves
+ */
+void reference_dp( const vector<Point>& contour, int start, int end, double epsilon, vector<uchar>& keep )
+{
+  if( end - start < 2 )
+    { return; }
+  Point a = contour[start], b = contour[end % contour.size()];
+  int64 dx = b.x - a.x, dy = b.y - a.y;
+  double best = -1;
+  int far = start;
+  for( int j = start + 1; j < end; j++ )
+  {
+    int64 px = contour[j].x - a.x, py = contour[j].y - a.y;
+    /// Squared distance to the line, times its squared length; to a when a == b
+    double d = dx || dy ? (double)(px * dy - py * dx) * (px * dy - py * dx) : (double)(px * px + py * py);
+    if( d > best )
+    {
+      best = d;
+      far = j;
+    }
+  }
+  double len2 = dx || dy ? (double)(dx * dx + dy * dy) : 1.;
+  if( best > epsilon * epsilon * len2 )
+  {
+    keep[far] = 1;
+    reference_dp( contour, start, far, epsilon, keep );
+    reference_dp( contour, far, end, epsilon, keep );
+  }
+}
+
+/**
+ * @function reference_simplify
+ * @brief Indices of the points Douglas-Peucker keeps of a closed contour,
+ * split first at point 0 and the point farthest from it, as the parallel
+ * simplifier does
+ */
+void reference_simplify( const vector<Point>& contour, double epsilon, vector<int>& kept )
+{
+  int k = (int)contour.size();
+  vector<uchar> keep( k, 0 );
+  if( k <= 2 )
+    { keep.assign( k, 1 ); }
+  else
+  {
+    int64 max_d2 = 0;
+    int far = 0;
+    for( int j = 1; j < k; j++ )
+    {
+      int64 dx = contour[j].x - contour[0].x, dy = contour[j].y - contour[0].y;
+      if( dx * dx + dy * dy > max_d2 )
+      {
+        max_d2 = dx * dx + dy * dy;
+        far = j;
+      }
+    }
+    keep[0] = 1;
+    if( (double)max_d2 > epsilon * epsilon )
+    {
+      keep[far] = 1;
+      reference_dp( contour, 0, far, epsilon, keep );
+      reference_dp( contour, far, k, epsilon, keep );
+    }
+  }
+  kept.clear();
+  for( int j = 0; j < k; j++ )
+    {
+      if( keep[j] ) { kept.push_back( j ); }
+    }
+}
+
+/**
+ * @function within_epsilon
+ * @brief Whether every point of a closed contour that is not kept lies
+ * within epsilon of the line through the kept points before and after it
+ */
+bool within_epsilon( const vector<Point>& contour, const vector<int>& kept, double epsilon )
+{
+  int k = (int)contour.size(), m = (int)kept.size();
+  for( int q = 0; q < m; q++ )
+  {
+    /// Points after kept one q, up to the next (around to the first)
+    Point p0 = contour[kept[q]], d = contour[kept[(q + 1) % m]] - p0;
+    int end = q + 1 < m ? kept[q + 1] : k;
+    double len = norm( d );
+    for( int j = kept[q] + 1; j < end; j++ )
+    {
+      Point v = contour[j] - p0;
+      double dist = len > 0 ? fabs( (double)v.x * d.y - (double)v.y * d.x ) / len : norm( v );
+      if( dist > epsilon + 1e-9 )
+        { return false; }
+    }
+  }
+  return true;
+}
+
+/**
+ * @function border_key
+ * @brief Contour i as its hole flag (an odd depth in the RETR_TREE
+ * hierarchy) followed by its coordinates, to find it in another list
+ */
+vector<int> border_key( const vector<Point>& contour, const vector<Vec4i>& hierarchy, int i )
+{
+  int depth = 0;
+  for( int p = hierarchy[i][3]; p >= 0; p = hierarchy[p][3] )
+    { depth++; }
+  vector<int> key( 1, depth & 1 );
+  for( size_t j = 0; j < contour.size(); j++ )
+  {
+    key.push_back( contour[j].x );
+    key.push_back( contour[j].y );
+  }
+  return key;
+}
+
+/**
+ * @function check_contours
+ * @brief Runs Canny + findContours and the cached Canny stages + parallel
+ * contours on every image at thresholds 0, step, 2 step... and counts the
+ * differences, including between the statistics gathered while tracing and
+ * contourArea, arcLength, boundingRect and moments. findContours
+ * lists the contours in its own order, so they are matched by their points
+ * and by being a hole or not (the first point alone is not enough: with
+ * CHAIN_APPROX_SIMPLE it is the first corner, not where the border was
+ * met, and different borders can start at the same one). The contours are
+ * also drawn, with drawContours one by one and with the batched rasterizer,
+ * and the two drawings compared. Finally the contours are simplified with
+ * approxPolyDP one by one and with the parallel simplifier; the latter is
+ * compared with a recursive Douglas-Peucker, and every point it drops is
+ * checked to be within epsilon of the line it was dropped for.
+ */
+int check_contours( const vector<string>& images, int step, double epsilon )
+{
+  int64 t_cv = 0, t_par = 0, t_canny = 0, t_stages = 0, t_draw = 0, t_raster = 0, t_dp = 0, t_simplify = 0;
+  int masks = 0, failures = 0, edge_failures = 0, stat_failures = 0, draw_failures = 0, simplify_failures = 0;
+  int epsilon_failures = 0;
+  vector<int> kept;
+  size_t total = 0, points = 0, dp_points = 0, simplified_points = 0, same_as_dp = 0;
+  tut::ContourArena arena, simplified;
+
+  for( size_t n = 0; n < images.size(); n++ )
+  {
+    Mat image = imread( images[n] ), gray, edges;
+    if( image.empty() )
+    {
+      cerr << "Cannot read " << images[n] << endl;
+      continue;
+    }
+    cvtColor( image, gray, COLOR_BGR2GRAY );
+    blur( gray, gray, Size(3,3) );
+    int64 t = getTickCount();
+    canny.setImage( gray );
+    t_stages += getTickCount() - t;
+
+    for( int th = 0; th <= max_thresh; th += step )
+    {
+      vector<vector<Point> > ref, par;
+      vector<Vec4i> ref_h, par_h;
+      vector<tut::ContourStats> par_stats;
+      Mat cached;
+      t = getTickCount();
+      Canny( gray, edges, th, th*2, 3 );
+      t_canny += getTickCount() - t;
+      t = getTickCount();
+      canny.edges( th, th*2, cached );
+      t_stages += getTickCount() - t;
+      int diff = countNonZero( edges != cached );
+      if( diff )
+      {
+        printf( "%s, threshold %d: cached Canny differs in %d pixels\n",
+                images[n].c_str(), th, diff );
+        edge_failures++;
+      }
+
+      int64 t0 = getTickCount();
+      findContours( edges, ref, ref_h, RETR_TREE, CHAIN_APPROX_SIMPLE );
+      vector<double> ref_area( ref.size() ), ref_len( ref.size() );
+      vector<Rect> ref_box( ref.size() );
+      vector<Moments> ref_m( ref.size() );
+      for( size_t i = 0; i < ref.size(); i++ )
+      {
+        ref_area[i] = contourArea( ref[i] );
+        ref_len[i] = arcLength( ref[i], true );
+        ref_box[i] = boundingRect( ref[i] );
+        ref_m[i] = moments( ref[i] );
+      }
+      int64 t1 = getTickCount();
+      finder.find( edges, par, par_h, true, 0, &par_stats );
+      t_par += getTickCount() - t1;
+      t_cv += t1 - t0;
+      masks++;
+      total += ref.size();
+
+      /// Our index of every findContours contour, by its points and whether
+      /// it is a hole: with CHAIN_APPROX_SIMPLE a border's first point is a
+      /// corner, which several borders may share
+      map<vector<int>, vector<int> > by_border;
+      for( size_t i = 0; i < par.size(); i++ )
+        { by_border[border_key( par[i], par_h, (int)i )].push_back( (int)i ); }
+      vector<int> to_par( ref.size(), -1 );
+      int bad = par.size() == ref.size() ? 0 : 1;
+      for( size_t i = 0; i < ref.size() && !bad; i++ )
+      {
+        map<vector<int>, vector<int> >::iterator it = by_border.find( border_key( ref[i], ref_h, (int)i ) );
+        if( it == by_border.end() || it->second.empty() ) { bad++; }
+        else
+        {
+          to_par[i] = it->second.back();
+          it->second.pop_back();
+        }
+      }
+      /// Same parents, through the matching
+      for( size_t i = 0; i < ref.size() && !bad; i++ )
+      {
+        int p = ref_h[i][3];
+        if( par_h[to_par[i]][3] != (p < 0 ? -1 : to_par[p]) ) { bad++; }
+      }
+      /// Same statistics, up to rounding
+      for( size_t i = 0; i < ref.size() && !bad; i++ )
+      {
+        const tut::ContourStats& st = par_stats[to_par[i]];
+        double e = 1e-6 * max( 1., st.m20 + st.m02 );
+        if( fabs( st.area - ref_area[i] ) > 1e-6 * max( 1., ref_area[i] ) ||
+            fabs( st.perimeter - ref_len[i] ) > 1e-4 * max( 1., ref_len[i] ) ||
+            st.bbox != ref_box[i] || fabs( st.m00 - ref_m[i].m00 ) > e ||
+            fabs( st.m10 - ref_m[i].m10 ) > e || fabs( st.m01 - ref_m[i].m01 ) > e ||
+            fabs( st.m20 - ref_m[i].m20 ) > e || fabs( st.m11 - ref_m[i].m11 ) > e ||
+            fabs( st.m02 - ref_m[i].m02 ) > e )
+        {
+          printf( "%s, threshold %d: statistics of contour %d differ\n", images[n].c_str(), th, (int)i );
+          stat_failures++;
+          break;
+        }
+      }
+      if( bad )
+      {
+        printf( "%s, threshold %d: %d vs %d contours, contours or hierarchy differ\n",
+                images[n].c_str(), th, (int)par.size(), (int)ref.size() );
+        failures++;
+      }
+
+      /// Same drawing
+      Mat drawn = Mat::zeros( edges.size(), CV_8UC3 ), rastered = drawn.clone();
+      t = getTickCount();
+      for( size_t i = 0; i < ref.size(); i++ )
+        { drawContours( drawn, ref, (int)i, Scalar( i & 255, (i >> 8) & 255, 128 ), 1, 8 ); }
+      t_draw += getTickCount() - t;
+      t = getTickCount();
+      raster.clear();
+      for( size_t i = 0; i < ref.size(); i++ )
+        { raster.add( &ref[i][0], (int)ref[i].size(), Scalar( i & 255, (i >> 8) & 255, 128 ) ); }
+      raster.draw( rastered );
+      t_raster += getTickCount() - t;
+      drawn = drawn.reshape( 1 );
+      rastered = rastered.reshape( 1 );
+      diff = countNonZero( drawn != rastered );
+      if( diff )
+      {
+        printf( "%s, threshold %d: batched drawing differs in %d values\n", images[n].c_str(), th, diff );
+        draw_failures++;
+      }
+
+      /// Simplification
+      vector<vector<Point> > dp( ref.size() );
+      t = getTickCount();
+      for( size_t i = 0; i < ref.size(); i++ )
+        { approxPolyDP( ref[i], dp[i], epsilon, true ); }
+      t_dp += getTickCount() - t;
+      arena.clear();
+      for( size_t i = 0; i < ref.size(); i++ )
+        { arena.add( ref[i] ); }
+      t = getTickCount();
+      simplifier.simplify( arena, simplified, epsilon );
+      t_simplify += getTickCount() - t;
+      points += arena.total();
+      simplified_points += simplified.total();
+      for( size_t i = 0; i < ref.size(); i++ )
+      {
+        dp_points += dp[i].size();
+        const Point* a = simplified.begin( (int)i );
+        int m = simplified.length( (int)i );
+        same_as_dp += dp[i].size() == (size_t)m && equal( a, a + m, dp[i].begin() );
+        /// The points a recursive Douglas-Peucker keeps, and those within
+        /// epsilon of what they are dropped for
+        reference_simplify( ref[i], epsilon, kept );
+        bool same = (int)kept.size() == m;
+        for( int q = 0; q < m && same; q++ )
+          { same = ref[i][kept[q]] == a[q]; }
+        if( !same )
+        {
+          printf( "%s, threshold %d: simplified contour %d differs from the recursive one\n",
+                  images[n].c_str(), th, (int)i );
+          simplify_failures++;
+          break;
+        }
+        if( !within_epsilon( ref[i], kept, epsilon ) )
+        {
+          printf( "%s, threshold %d: simplified contour %d is not within epsilon\n", images[n].c_str(), th, (int)i );
+          epsilon_failures++;
+          break;
+        }
+      }
+    }
+  }
+
+  double f = 1000. / getTickFrequency();
+  printf( "%d masks, %d contours, %d mismatching masks, %d mismatching edge maps, %d mismatching statistics, "
+          "%d mismatching drawings, %d mismatching simplifications, %d beyond epsilon\n", masks, (int)total,
+          failures, edge_failures, stat_failures, draw_failures, simplify_failures, epsilon_failures );
+  if( masks )
+  {
+    printf( "Canny %.2f ms, cached stages %.2f ms per mask (gradient included)\n",
+            t_canny * f / masks, t_stages * f / masks );
+    printf( "findContours + statistics %.2f ms, parallel with statistics %.2f ms per mask (%d threads)\n",
+            t_cv * f / masks, t_par * f / masks, getNumThreads() );
+    printf( "drawContours per contour %.2f ms, batched %.2f ms per mask\n",
+            t_draw * f / masks, t_raster * f / masks );
+    printf( "epsilon %g: approxPolyDP keeps %.1f%% of %d points, %.3f ms per 1k contours; parallel keeps %.1f%%, "
+            "%.3f ms per 1k contours; %d of %d contours the same\n", epsilon,
+            100. * dp_points / max( (size_t)1, points ), (int)points, t_dp * f * 1000. / max( (size_t)1, total ),
+            100. * simplified_points / max( (size_t)1, points ), t_simplify * f * 1000. / max( (size_t)1, total ),
+            (int)same_as_dp, (int)total );
+  }
+  return failures || edge_failures || stat_failures || draw_failures || simplify_failures || epsilon_failures ? 1 : 0;
+}
@@ -7,6 +7,7 @@
 #include "opencv2/imgcodecs.hpp"
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/imgproc/imgproc.hpp"
+#include "HoughAccumulator.hpp"
 #include <iostream>
 #include <stdio.h>
 
@@ -28,18 +29,28 @@ const char* probabilistic_name = "Probabilistic Hough Lines Demo";
 int s_trackbar = max_trackbar;
 int p_trackbar = max_trackbar;
 
+/** Standard Hough accumulator of edges, voted once */
+tut::HoughLineAccumulator hough;
+
 /// Function Headers
 void help();
 void Standard_Hough( int, void* );
 void Probabilistic_Hough( int, void* );
+int check_hough();
+int bench_hough();
 
 /**
  * @function main
  */
-int main( int, char** argv )
+int main( int argc, char** argv )
 {
+   CommandLineParser parser( argc, argv,
+       "{@image |   | input image}"
+       "{check  |   | compare the cached accumulator with HoughLines at every threshold}"
+       "{bench  |   | time HoughLines and the parallel accumulator on dense Canny output at 1080p and 4K}" );
+
    /// Read the image
-   src = imread( argv[1], 1 );
+   src = imread( parser.get<string>( "@image" ), 1 );
 
    if( src.empty() )
      { help();
@@ -52,6 +63,19 @@ int main( int, char** argv )
    /// Apply Canny edge detector
    Canny( src_gray, edges, 50, 200, 3 );
 
+   if( parser.has( "bench" ) )
+     { return bench_hough(); }
+
+   /// Vote once, on all threads: the trackbar then only picks peaks out of
+   /// the accumulator
+   int64 t = getTickCount();
+   hough.setImage( edges, 1, CV_PI/180 );
+   printf( "Accumulator and %d peaks in %.2f ms\n", hough.peakCount(),
+           (getTickCount() - t) * 1000. / getTickFrequency() );
+
+   if( parser.has( "check" ) )
+     { return check_hough(); }
+
    /// Create Trackbars for Thresholds
    char thresh_label[50];
    sprintf( thresh_label, "Thres: %d + input", min_threshold );
@@ -77,7 +101,7 @@ void help()
 {
   printf("\t Hough Transform to detect lines \n ");
   printf("\t---------------------------------\n ");
-  printf(" Usage: ./HoughLines_Demo <image_name> \n");
+  printf(" Usage: ./HoughLines_Demo <image_name> [--check] [--bench] \n");
 }
 
 /**
@@ -88,8 +112,12 @@ void Standard_Hough( int, void* )
   vector<Vec2f> s_lines;
   cvtColor( edges, standard_hough, COLOR_GRAY2BGR );
 
-  /// 1. Use Standard Hough Transform
-  HoughLines( edges, s_lines, 1, CV_PI/180, min_threshold + s_trackbar, 0, 0 );
+  /// 1. Use Standard Hough Transform: the lines of
+  /// HoughLines( edges, s_lines, 1, CV_PI/180, min_threshold + s_trackbar, 0, 0 ),
+  /// from the accumulator voted once
+  int64 t = getTickCount();
+  hough.lines( min_threshold + s_trackbar, s_lines );
+  printf( "%d lines in %.3f ms\n", (int)s_lines.size(), (getTickCount() - t) * 1000. / getTickFrequency() );
 
   /// Show the result
   for( size_t i = 0; i < s_lines.size(); i++ )
@@ -127,3 +155,83 @@ void Probabilistic_Hough( int, void* )
 
    imshow( probabilistic_name, probabilistic_hough );
 }
+
+/**
+ * @function check_hough
+ * @brief Compares HoughLines with the cached accumulator at every threshold
+ * of the trackbar, and times both
+ */
+int check_hough()
+{
+  int64 t_cv = 0, t_cached = 0;
+  int failures = 0, thresholds = 0;
+  for( int th = min_threshold; th <= min_threshold + max_trackbar; th++ )
+  {
+    vector<Vec2f> ref, cached;
+    int64 t = getTickCount();
+    HoughLines( edges, ref, 1, CV_PI/180, th, 0, 0 );
+    t_cv += getTickCount() - t;
+    t = getTickCount();
+    hough.lines( th, cached );
+    t_cached += getTickCount() - t;
+    thresholds++;
+    if( ref != cached )
+    {
+      printf( "threshold %d: %d vs %d lines, lines differ\n", th, (int)cached.size(), (int)ref.size() );
+      failures++;
+    }
+  }
+
+  double f = 1000. / getTickFrequency();
+  printf( "%d thresholds, %d mismatching\n", thresholds, failures );
+  printf( "HoughLines %.3f ms, cached accumulator %.3f ms per threshold (%d edge pixels)\n",
+          t_cv * f / thresholds, t_cached * f / thresholds, countNonZero( edges ) );
+  return failures ? 1 : 0;
+}
+
+/**
+ * @function bench_hough
+ * @brief Times HoughLines and the accumulator, voting on one thread and on
+ * all of them, on the image scaled to 1080p and 4K with low Canny thresholds
+ * for dense edges, and checks that the lines are the same
+ */
+int bench_hough()
+{
+  const Size sizes[] = { Size( 1920, 1080 ), Size( 3840, 2160 ) };
+  const int runs = 3, threshold = min_threshold + max_trackbar;
+  int failures = 0;
+  double f = 1000. / getTickFrequency();
+
+  for( int s = 0; s < 2; s++ )
+  {
+    Mat gray, dense;
+    resize( src_gray, gray, sizes[s] );
+    Canny( gray, dense, 10, 30, 3 );
+
+    int64 t_cv = 0, t_one = 0, t_all = 0;
+    vector<Vec2f> ref, one, all;
+    for( int run = 0; run < runs; run++ )
+    {
+      int64 t = getTickCount();
+      HoughLines( dense, ref, 1, CV_PI/180, threshold, 0, 0 );
+      t_cv += getTickCount() - t;
+      t = getTickCount();
+      hough.setImage( dense, 1, CV_PI/180, 1 );
+      hough.lines( threshold, one );
+      t_one += getTickCount() - t;
+      t = getTickCount();
+      hough.setImage( dense, 1, CV_PI/180 );
+      hough.lines( threshold, all );
+      t_all += getTickCount() - t;
+    }
+    if( one != ref || all != ref )
+    {
+      printf( "%dx%d: lines differ from HoughLines\n", sizes[s].width, sizes[s].height );
+      failures++;
+    }
+    printf( "%dx%d, %d edge pixels, %d lines: HoughLines %.1f ms, accumulator on 1 thread %.1f ms, "
+            "on %d threads %.1f ms\n", sizes[s].width, sizes[s].height, countNonZero( dense ), (int)ref.size(),
+            t_cv * f / runs, t_one * f / runs, getNumThreads(), t_all * f / runs );
+  }
+  return failures ? 1 : 0;
+}
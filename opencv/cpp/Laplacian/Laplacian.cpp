@@ -1,43 +1,88 @@
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
+#include "DerivativeOps.hpp"
+#include "TiledLaplacian.hpp"
+#include "FramePipeline.hpp"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string>
 
 using namespace cv;
+using std::string;
+
+int stream_edges( const CommandLineParser& parser, int kernel_size );
 
 /** @function main */
 int main( int argc, char** argv )
 {
+  CommandLineParser parser( argc, argv,
+      "{@image | | input image}"
+      "{ksize  | 3 | aperture size: 1, 3 or 5}"
+      "{bench  | | print the throughput of every derivative operator}"
+      "{video  | | stream a video file, or a camera given by its index, instead}"
+      "{out    | | with --video, write the edge video to this file}"
+      "{slots  | 4 | with --video, frames in flight in the pipeline}" );
+
   Mat src, src_gray, dst;
-  int kernel_size = 3;
-  int scale = 1;
-  int delta = 0;
-  int ddepth = CV_16S;
+  int kernel_size = parser.get<int>( "ksize" );
   const char* window_name = "Laplace Demo";
 
   int c;
 
+  /// Pick the compiled operator for this aperture; it gives ddepth = CV_16S,
+  /// scale = 1 and delta = 0
+  char op_name[32];
+  sprintf( op_name, "laplacian%d", kernel_size );
+  const tut::DerivativeOperator* op = tut::findDerivativeOperator( op_name );
+  if( !op )
+  {
+    printf( "Unsupported ksize %d, use 1, 3 or 5\n", kernel_size );
+    return -1;
+  }
+
+  if( parser.has( "video" ) )
+  { return stream_edges( parser, kernel_size ); }
+
   /// Load an image
-  src = imread( argv[1] );
+  src = imread( parser.get<string>( "@image" ) );
 
   if( !src.data )
     { return -1; }
 
+  /// All four steps below fused into one pass over bands of rows; it blurs
+  /// after the gray conversion, so it can differ by rounding
+  Mat fused;
+  int64 f0 = getTickCount();
+  tut::tiledLaplacianEdges( src, fused, kernel_size );
+  int64 f1 = getTickCount();
+
+  int64 t0 = getTickCount();
+
   /// Remove noise by blurring with a Gaussian filter
   GaussianBlur( src, src, Size(3,3), 0, 0, BORDER_DEFAULT );
 
   /// Convert the image to grayscale
   cvtColor( src, src_gray, CV_BGR2GRAY );
 
-  /// Create window
-  namedWindow( window_name, CV_WINDOW_AUTOSIZE );
-
   /// Apply Laplace function
   Mat abs_dst;
 
-  Laplacian( src_gray, dst, ddepth, kernel_size, scale, delta, BORDER_DEFAULT );
+  /// Same as Laplacian( src_gray, dst, CV_16S, kernel_size, 1, 0, BORDER_DEFAULT )
+  op->apply( src_gray, dst );
   convertScaleAbs( dst, abs_dst );
 
+  int64 t1 = getTickCount();
+
+  printf( "Four passes: %.2f ms, tiled: %.2f ms, max difference: %g\n",
+          (t1 - t0) * 1000. / getTickFrequency(), (f1 - f0) * 1000. / getTickFrequency(),
+          norm( abs_dst, fused, NORM_INF ) );
+
+  if( parser.has( "bench" ) )
+  { tut::benchmarkDerivativeOperators( src_gray ); }
+
+  /// Create window
+  namedWindow( window_name, CV_WINDOW_AUTOSIZE );
+
   /// Show what you got
   imshow( window_name, abs_dst );
 
@@ -45,3 +90,36 @@ int main( int argc, char** argv )
 
   return 0;
   }
+
+/**
+ * @function stream_edges
+ * @brief Laplacian edges of every frame of a video, with decoding, gray
+ *        conversion, the tiled blur and Laplacian, and encoding running on
+ *        separate threads
+ */
+int stream_edges( const CommandLineParser& parser, int kernel_size )
+{
+  VideoCapture capture;
+  if( !tut::openVideoSource( capture, parser.get<string>( "video" ) ) )
+  {
+    printf( "Cannot open %s\n", parser.get<string>( "video" ).c_str() );
+    return -1;
+  }
+
+  VideoWriter writer;
+  if( parser.has( "out" ) )
+  {
+    double fps = capture.get( CAP_PROP_FPS );
+    Size size( (int)capture.get( CAP_PROP_FRAME_WIDTH ), (int)capture.get( CAP_PROP_FRAME_HEIGHT ) );
+    writer.open( parser.get<string>( "out" ), VideoWriter::fourcc( 'M', 'J', 'P', 'G' ),
+                 fps > 0 ? fps : 30, size, false );
+  }
+
+  tut::FramePipeline pipeline( std::max( parser.get<int>( "slots" ), 2 ) );
+  pipeline.run( capture, &writer,
+    [&]( tut::FrameSlot& slot ) { cvtColor( slot.frame, slot.gray, CV_BGR2GRAY ); },
+    [&]( tut::FrameSlot& slot ) { tut::tiledLaplacianEdges( slot.gray, slot.edges, kernel_size ); } );
+  pipeline.report();
+
+  return 0;
+}
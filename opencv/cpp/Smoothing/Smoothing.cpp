@@ -11,9 +11,13 @@
 
 // Normalized box filter is the simplest filter.
 // Each output pixel is the mean of its kernel neighbors.
+// Here it is computed from an integral image (see ../common/IntegralImage.hpp),
+// so every kernel size costs the same four lookups per pixel.
 
 // Gaussian filter is not the fastest, but is probably the most useful filter.
 // Each point in the input array is convolved with a Gaussian kernel and summed.
+// The sweep also runs a recursive (IIR) Gaussian of the same sigma, whose cost
+// does not grow with the kernel, and prints how far it is from GaussianBlur.
 
 // Median filter runs through each element of the signal and replaces each
 // pixel with the median of its neighboring pixels.
@@ -24,9 +28,21 @@
 
 // This program loads an image and applies 4 different types of filters.
 
+// With --bench it runs headless instead: every filter over the whole kernel
+// sweep on every image given, with no windows and no delays, and prints the
+// throughput of each filter at each kernel size in megapixels per second.
+//   Smoothing --bench [--repeat N] [--out dir] image [image ...]
+// Filtered images are only written when --out is given.
+
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
+#include "IntegralImage.hpp"
+#include "RecursiveGaussian.hpp"
 #include <iostream>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
 
 using namespace std;
 using namespace cv;
@@ -42,15 +58,32 @@ char window_name[] = "Filter Demo 1";
 /// Function headers
 int display_caption( const char* caption );
 int display_dst( int delay );
+int run_benchmark( const vector<string>& images, const string& out_dir, int repeats );
 
 int main( int argc, char** argv)
 {
-    namedWindow(window_name, CV_WINDOW_AUTOSIZE);
+    bool bench = false;
+    string out_dir;
+    int repeats = 3;
+    vector<string> images;
+    for( int a = 1; a < argc; a++ )
+    {
+        string arg = argv[a];
+        if( arg == "--bench" ) { bench = true; }
+        else if( arg == "--out" && a + 1 < argc ) { out_dir = argv[++a]; }
+        else if( arg == "--repeat" && a + 1 < argc ) { repeats = max( 1, atoi(argv[++a]) ); }
+        else { images.push_back( arg ); }
+    }
+
+    if( bench && !images.empty() )
+    {
+        return run_benchmark( images, out_dir, repeats );
+    }
 
     // Load the source image
-    if( argc == 2)
+    if( images.size() == 1 )
     {
-        src = imread(argv[1], CV_LOAD_IMAGE_COLOR);
+        src = imread(images[0], CV_LOAD_IMAGE_COLOR);
         if( src.empty() )
         {
             return -1;
@@ -59,9 +92,12 @@ int main( int argc, char** argv)
     else
     {
         cout << "Usage: Smoothing path_to_image" << endl;
+        cout << "       Smoothing --bench [--repeat N] [--out dir] image [image ...]" << endl;
         return -1;
     }
 
+    namedWindow(window_name, CV_WINDOW_AUTOSIZE);
+
     if( display_caption( "Original Image" ) != 0) { return 0; }
 
     dst = src.clone();
@@ -69,18 +105,24 @@ int main( int argc, char** argv)
 
     // Applying homogenous blur
     if( display_caption( "Homogeneous Blur" ) != 0 ) { return 0; }
+    tut::BoxFilter box;
+    box.reserve( src.size(), src.type(), Size( MAX_KERNEL_LENGTH, MAX_KERNEL_LENGTH ) );
     for (int i = 1; i < MAX_KERNEL_LENGTH; i = i + 2)
     {
         // Size(w, h) defines the size of the kernel, w/h in pixels
         // Point(-1, -1) indicates where the anchor point is located with
         // respect to the neighborhood. A negative value sets the
         // center of the kernel as the anchor point.
-        blur(src, dst, Size(i, i), Point (-1, -1));
+        // Same output as blur(src, dst, Size(i, i), Point(-1, -1)), with the
+        // padded image and integral image in the buffers reserved above.
+        box.apply(src, dst, Size(i, i), Point (-1, -1));
         if( display_dst( DELAY_BLUR ) != 0 ) { return 0; }
     }
 
     // Applying Gaussian blur
     if( display_caption( "Gaussian Blur" ) != 0 ) { return 0; }
+    tut::RecursiveGaussian recursive;
+    Mat iir;
     for (int i = 1; i < MAX_KERNEL_LENGTH; i = i + 2)
     {
         // Size(w, h) is the size of the kernel, which is the number of
@@ -89,7 +131,20 @@ int main( int argc, char** argv)
         // arguments.
         // 0, 0 are the standard deviation x and y. 0 implies that they
         // are calculated using the kernel size.
+        int64 t0 = getTickCount();
         GaussianBlur(src, dst, Size(i, i), 0, 0);
+        int64 t1 = getTickCount();
+        recursive.apply(src, iir, tut::gaussianSigma(i));
+        int64 t2 = getTickCount();
+
+        // Kernel size 1 is a copy for GaussianBlur, while the recursive
+        // filter still applies the smallest sigma it supports (0.5).
+        cout << "Gaussian " << i << "x" << i
+             << ": max error " << norm(dst, iir, NORM_INF)
+             << ", PSNR " << PSNR(dst, iir) << " dB"
+             << ", GaussianBlur " << (t1 - t0) * 1000. / getTickFrequency() << " ms"
+             << ", recursive " << (t2 - t1) * 1000. / getTickFrequency() << " ms"
+             << endl;
         if( display_dst( DELAY_BLUR ) != 0 ) { return 0; }
     }
 
@@ -146,3 +201,106 @@ int display_dst ( int delay )
     }
     return 0;
 }
+
+/// Filters run by the benchmark, in the same order as the demo
+typedef void (*smoothing_fn)( const Mat& src, Mat& dst, int ksize );
+
+static void homogeneous_blur( const Mat& src, Mat& dst, int i )
+{ blur(src, dst, Size(i, i), Point(-1, -1)); }
+
+static void integral_box( const Mat& src, Mat& dst, int i )
+{
+    static tut::BoxFilter box;
+    box.apply(src, dst, Size(i, i), Point(-1, -1));
+}
+
+static void gaussian_blur( const Mat& src, Mat& dst, int i )
+{ GaussianBlur(src, dst, Size(i, i), 0, 0); }
+
+static void recursive_gaussian( const Mat& src, Mat& dst, int i )
+{
+    static tut::RecursiveGaussian recursive;
+    recursive.apply(src, dst, tut::gaussianSigma(i));
+}
+
+static void median_blur( const Mat& src, Mat& dst, int i )
+{ medianBlur(src, dst, i); }
+
+static void bilateral_blur( const Mat& src, Mat& dst, int i )
+{ bilateralFilter(src, dst, i, i*2, i/2); }
+
+struct smoothing_filter { const char* name; smoothing_fn apply; };
+
+static const smoothing_filter filters[] =
+{
+    { "blur",            homogeneous_blur },
+    { "box (integral)",  integral_box },
+    { "GaussianBlur",    gaussian_blur },
+    { "Gaussian (IIR)",  recursive_gaussian },
+    { "medianBlur",      median_blur },
+    { "bilateralFilter", bilateral_blur }
+};
+
+int run_benchmark( const vector<string>& images, const string& out_dir, int repeats )
+{
+    setNumThreads( getNumberOfCPUs() );
+
+    vector<Mat> srcs;
+    double megapixels = 0;
+    for( size_t n = 0; n < images.size(); n++ )
+    {
+        Mat img = imread(images[n], CV_LOAD_IMAGE_COLOR);
+        if( img.empty() )
+        {
+            cout << "Image not valid: " << images[n] << endl;
+            return -1;
+        }
+        srcs.push_back( img );
+        megapixels += img.total() * 1e-6;
+    }
+
+    const int num_filters = sizeof(filters) / sizeof(filters[0]);
+    cout << srcs.size() << " image(s), " << megapixels << " MP, "
+         << repeats << " repeat(s), " << getNumThreads() << " thread(s)" << endl;
+    cout << "Throughput in MP/s per kernel size" << endl;
+
+    printf( "%-16s", "filter" );
+    for( int i = 1; i < MAX_KERNEL_LENGTH; i = i + 2 ) { printf( "%8d", i ); }
+    printf( "\n" );
+
+    Mat out;
+    for( int f = 0; f < num_filters; f++ )
+    {
+        printf( "%-16s", filters[f].name );
+        for( int i = 1; i < MAX_KERNEL_LENGTH; i = i + 2 )
+        {
+            int64 ticks = 0;
+            for( size_t n = 0; n < srcs.size(); n++ )
+            {
+                // Untimed first call so buffer allocation is not measured
+                filters[f].apply( srcs[n], out, i );
+                int64 t0 = getTickCount();
+                for( int r = 0; r < repeats; r++ ) { filters[f].apply( srcs[n], out, i ); }
+                ticks += getTickCount() - t0;
+
+                if( !out_dir.empty() )
+                {
+                    char name[64];
+                    sprintf( name, "/%d_%d_%d.png", (int)n, f, i );
+                    imwrite( out_dir + name, out );
+                }
+            }
+            double seconds = ticks / getTickFrequency();
+            printf( "%8.1f", megapixels * repeats / seconds );
+            fflush( stdout );
+        }
+        printf( "\n" );
+    }
+
+    if( !out_dir.empty() )
+    {
+        cout << "Outputs written to " << out_dir
+             << " as <image index>_<filter row>_<kernel size>.png" << endl;
+    }
+    return 0;
+}
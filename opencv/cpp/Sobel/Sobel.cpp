@@ -1,25 +1,53 @@
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
+#include "FusedSobel.hpp"
+#include "GradientField.hpp"
+#include "DerivativeOps.hpp"
+#include "FramePipeline.hpp"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string>
 
 using namespace cv;
+using std::string;
+
+int stream_edges( const CommandLineParser& parser, const tut::DerivativeOperator* op_x,
+                  const tut::DerivativeOperator* op_y );
 
 /** @function main */
 int main( int argc, char** argv )
 {
 
+  CommandLineParser parser( argc, argv,
+      "{@image | | input image}"
+      "{op     | sobel3 | derivative operator: sobel3, sobel5, sobel7 or scharr}"
+      "{bench  | | print the throughput of every derivative operator}"
+      "{video  | | stream a video file, or a camera given by its index, instead}"
+      "{out    | | with --video, write the edge video to this file}"
+      "{slots  | 4 | with --video, frames in flight in the pipeline}" );
+
   Mat src, src_gray;
   Mat grad;
   const char* window_name = "Sobel Demo - Simple Edge Detector";
-  int scale = 1;
-  int delta = 0;
-  int ddepth = CV_16S;
 
   int c;
 
+  /// Pick the compiled x and y operators, they give ddepth = CV_16S,
+  /// scale = 1 and delta = 0
+  string op_name = parser.get<string>( "op" );
+  const tut::DerivativeOperator* op_x = tut::findDerivativeOperator( op_name + "_dx" );
+  const tut::DerivativeOperator* op_y = tut::findDerivativeOperator( op_name + "_dy" );
+  if( !op_x || !op_y )
+  {
+    printf( "Unknown operator %s, use sobel3, sobel5, sobel7 or scharr\n", op_name.c_str() );
+    return -1;
+  }
+
+  if( parser.has( "video" ) )
+  { return stream_edges( parser, op_x, op_y ); }
+
   /// Load an image
-  src = imread( argv[1] );
+  src = imread( parser.get<string>( "@image" ) );
 
   if( !src.data )
   { return -1; }
@@ -29,6 +57,9 @@ int main( int argc, char** argv )
   /// Convert it to gray
   cvtColor( src, src_gray, CV_BGR2GRAY );
 
+  if( parser.has( "bench" ) )
+  { tut::benchmarkDerivativeOperators( src_gray ); }
+
   /// Create window
   namedWindow( window_name, CV_WINDOW_AUTOSIZE );
 
@@ -36,22 +67,106 @@ int main( int argc, char** argv )
   Mat grad_x, grad_y;
   Mat abs_grad_x, abs_grad_y;
 
-  /// Gradient X
-  //Scharr( src_gray, grad_x, ddepth, 1, 0, scale, delta, BORDER_DEFAULT );
-  Sobel( src_gray, grad_x, ddepth, 1, 0, 3, scale, delta, BORDER_DEFAULT );
+  int64 t0 = getTickCount();
+
+  /// Gradient X, same as Sobel( src_gray, grad_x, CV_16S, 1, 0, ksize ),
+  /// or Scharr( src_gray, grad_x, CV_16S, 1, 0 ) for --op=scharr
+  op_x->apply( src_gray, grad_x );
   convertScaleAbs( grad_x, abs_grad_x );
 
   /// Gradient Y
-  //Scharr( src_gray, grad_y, ddepth, 0, 1, scale, delta, BORDER_DEFAULT );
-  Sobel( src_gray, grad_y, ddepth, 0, 1, 3, scale, delta, BORDER_DEFAULT );
+  op_y->apply( src_gray, grad_y );
   convertScaleAbs( grad_y, abs_grad_y );
 
   /// Total Gradient (approximate)
   addWeighted( abs_grad_x, 0.5, abs_grad_y, 0.5, 0, grad );
 
+  int64 t1 = getTickCount();
+
+  printf( "%s, five passes: %.2f ms\n", op_name.c_str(), (t1 - t0) * 1000. / getTickFrequency() );
+
+  /// Same result in a single pass, with no intermediate images (3x3 Sobel only)
+  if( op_x->ksize == 3 )
+  {
+    Mat fused;
+    int64 f0 = getTickCount();
+    tut::fusedSobel( src_gray, fused );
+    int64 f1 = getTickCount();
+
+    printf( "fused: %.2f ms, differing pixels: %d\n",
+            (f1 - f0) * 1000. / getTickFrequency(), countNonZero( grad != fused ) );
+  }
+
   imshow( window_name, grad );
 
+  /// True (L2) magnitude and orientation quantized to 9 bins over [0, 180),
+  /// plus HOG-style 8x8 cell histograms, from one more pass
+  Mat magnitude, orientation, cell_hist;
+  int64 t3 = getTickCount();
+  tut::gradientField( src_gray, magnitude, orientation, 9, false, &cell_hist, 8 );
+  int64 t4 = getTickCount();
+
+  printf( "Magnitude, orientation and %d x %d cell histograms: %.2f ms\n",
+          cell_hist.rows, cell_hist.cols / 9, (t4 - t3) * 1000. / getTickFrequency() );
+
+  Mat abs_magnitude;
+  convertScaleAbs( magnitude, abs_magnitude, 0.25 );
+  namedWindow( "Gradient magnitude (L2)", CV_WINDOW_AUTOSIZE );
+  imshow( "Gradient magnitude (L2)", abs_magnitude );
+
   waitKey(0);
 
   return 0;
   }
+
+/**
+ * @function stream_edges
+ * @brief Same edge detector on every frame of a video, with decoding,
+ *        preprocessing, detection and encoding running on separate threads
+ */
+int stream_edges( const CommandLineParser& parser, const tut::DerivativeOperator* op_x,
+                  const tut::DerivativeOperator* op_y )
+{
+  VideoCapture capture;
+  if( !tut::openVideoSource( capture, parser.get<string>( "video" ) ) )
+  {
+    printf( "Cannot open %s\n", parser.get<string>( "video" ).c_str() );
+    return -1;
+  }
+
+  VideoWriter writer;
+  if( parser.has( "out" ) )
+  {
+    double fps = capture.get( CAP_PROP_FPS );
+    Size size( (int)capture.get( CAP_PROP_FRAME_WIDTH ), (int)capture.get( CAP_PROP_FRAME_HEIGHT ) );
+    writer.open( parser.get<string>( "out" ), VideoWriter::fourcc( 'M', 'J', 'P', 'G' ),
+                 fps > 0 ? fps : 30, size, false );
+  }
+
+  /// Only the detector thread touches these, so they are allocated once
+  Mat grad_x, grad_y, abs_grad_x, abs_grad_y;
+
+  tut::FramePipeline pipeline( std::max( parser.get<int>( "slots" ), 2 ) );
+  pipeline.run( capture, &writer,
+    [&]( tut::FrameSlot& slot )
+    {
+      GaussianBlur( slot.frame, slot.frame, Size(3,3), 0, 0, BORDER_DEFAULT );
+      cvtColor( slot.frame, slot.gray, CV_BGR2GRAY );
+    },
+    [&]( tut::FrameSlot& slot )
+    {
+      if( op_x->ksize == 3 )
+      { tut::fusedSobel( slot.gray, slot.edges ); }
+      else
+      {
+        op_x->apply( slot.gray, grad_x );
+        convertScaleAbs( grad_x, abs_grad_x );
+        op_y->apply( slot.gray, grad_y );
+        convertScaleAbs( grad_y, abs_grad_y );
+        addWeighted( abs_grad_x, 0.5, abs_grad_y, 0.5, 0, slot.edges );
+      }
+    } );
+  pipeline.report();
+
+  return 0;
+}
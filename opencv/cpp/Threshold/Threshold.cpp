@@ -28,8 +28,37 @@
 //  if the intensity of a pixel is higher than thresh, then the new pixel
 //  intensity is set to 0
 
+// With --auto the threshold is picked from the image's histogram instead:
+//  otsu      the split that best separates two classes of intensity
+//  triangle  suited to one dominant peak with a long tail
+//  multi     Otsu generalized to --levels classes, giving levels-1 thresholds
+// The result is binary (or --levels gray levels) and can be written with
+// --out, in which case no window is opened. A binary result written to a
+// .pbm file is packed to one bit per pixel straight from the gray image.
+
+// With --adaptive every pixel gets its own threshold from the block around
+// it, which copes with uneven lighting:
+//  bradley   above the block mean less k (default 15%)
+//  sauvola   above the block mean, lowered where the block has little
+//            contrast (k defaults to 0.34)
+// --block sets the block size, --bench times both against adaptiveThreshold
+// for growing block sizes.
+
+// --open=N and --close=N clean a binary --auto or --adaptive result with an
+// N x N square before it is shown or written.
+
+// --ladder=32,64,128 (or --ladder=32 for every multiple of 32) shows all the
+// --types at all the values side by side, one row per value and one column
+// per type, computed in a single read of the image.
+
 #include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/highgui/highgui.hpp"
+#include "AutoThreshold.hpp"
+#include "ThresholdLUT.hpp"
+#include "PackedBinary.hpp"
+#include "LocalThreshold.hpp"
+#include "ThresholdLadder.hpp"
+#include "RectMorphology.hpp"
 #include <stdlib.h>
 #include <stdio.h>
 #include <iostream>
@@ -51,22 +80,53 @@ const char* window_name = "Threshold Demo";
 const char* trackbar_type = "Type: \n 0: Binary \n 1: Binary Inverted \n 2: Truncate \n 3: To Zero \n 4: To Zero Inverted";
 const char* trackbar_value = "Value";
 
+// Every (type, value) pair as a 256 entry table, built once
+tut::ThresholdTables threshold_tables( max_BINARY_value );
+bool render_pending = false;
+
 /// Function headers
 void Threshold_Demo( int, void* );
+void Render_Threshold();
+int Auto_Threshold( const CommandLineParser& parser );
+int Adaptive_Threshold( const CommandLineParser& parser );
+int Threshold_Ladder( const CommandLineParser& parser );
+bool Clean_Mask( const CommandLineParser& parser );
 
 int main( int argc, char** argv )
 {
+    CommandLineParser parser( argc, argv,
+        "{@image |   | input image}"
+        "{auto   |   | pick the threshold automatically: otsu, triangle or multi}"
+        "{levels | 3 | number of classes for --auto=multi}"
+        "{adaptive |  | threshold each pixel against its block: bradley or sauvola}"
+        "{block  | 31 | block size for --adaptive, odd}"
+        "{k      | -1 | --adaptive parameter, -1 for the method's default}"
+        "{bench  |   | with --adaptive, compare with adaptiveThreshold over block sizes}"
+        "{open   | 0 | remove specks smaller than an N x N square from the binary result}"
+        "{close  | 0 | fill gaps smaller than an N x N square in the binary result}"
+        "{ladder |   | threshold values to compare, e.g. 32,64,128, or a single step}"
+        "{types  | 01234 | with --ladder, the threshold types to show}"
+        "{out    |   | with --auto, --adaptive or --ladder, write the result here instead of showing it}" );
+
     // Load an image
-    src = imread( argv[1], 1 );
+    string filename = parser.get<string>( "@image" );
+    src = imread( filename, 1 );
     if( src.empty() )
     {
-        cout << "Image not valid: " << argv[1] << endl;
+        cout << "Image not valid: " << filename << endl;
         return -1;
     }
 
     // Convert to greyscale
     cvtColor( src, src_gray, CV_BGR2GRAY );
 
+    if( parser.has( "auto" ) )
+    { return Auto_Threshold( parser ); }
+    if( parser.has( "adaptive" ) )
+    { return Adaptive_Threshold( parser ); }
+    if( parser.has( "ladder" ) )
+    { return Threshold_Ladder( parser ); }
+
     // Create a window
     namedWindow( window_name, CV_WINDOW_AUTOSIZE) ;
 
@@ -77,13 +137,30 @@ int main( int argc, char** argv )
             max_value, Threshold_Demo );
 
     // Initial call to function to intialize
-    Threshold_Demo( 0, 0 );
+    Render_Threshold();
 
-    waitKey (0);
+    // The trackbar callbacks only mark the image stale. waitKey delivers all
+    // the events queued so far before returning, so a burst of them while
+    // dragging ends in one render, with the latest setting
+    for( ;; )
+    {
+        if( waitKey( 15 ) >= 0 )
+        { break; }
+        if( render_pending )
+        {
+            render_pending = false;
+            Render_Threshold();
+        }
+    }
     return 0;
 }
 
 void Threshold_Demo( int, void* )
+{
+    render_pending = true;
+}
+
+void Render_Threshold()
 {
       /* 0: Binary
          1: Binary Inverted
@@ -92,11 +169,270 @@ void Threshold_Demo( int, void* )
          4: Threshold to Zero Inverted
        */
 
-    // input_image, output_image, threshold_value, maxval, type_of_threshold
-    // typically used for binarizing an image or removing noise -
-    // removing pixels with too small or too large values
-    threshold( src_gray, dst, 
-            threshold_value, max_BINARY_value, threshold_type);
+    // Same as threshold( src_gray, dst, threshold_value, max_BINARY_value,
+    // threshold_type ): all five types are point operations, so the setting
+    // is just a lookup table, applied in parallel
+    tut::applyTable( src_gray, dst,
+            threshold_tables.get( threshold_type, threshold_value ) );
 
     imshow(window_name, dst);
 }
+
+int Auto_Threshold( const CommandLineParser& parser )
+{
+    string method = parser.get<string>( "auto" );
+    int levels = method == "multi" ? parser.get<int>( "levels" ) : 2;
+    if( (method != "otsu" && method != "triangle" && method != "multi") ||
+        levels < 2 || levels > 256 )
+    {
+        cout << "Use --auto=otsu, --auto=triangle or --auto=multi --levels=N (N >= 2)" << endl;
+        return -1;
+    }
+
+    // One parallel pass over the image for the histogram; the thresholds
+    // come from its 256 bins alone
+    int64 t0 = getTickCount();
+    unsigned hist[256];
+    tut::histogram256( src_gray, hist );
+    int64 t1 = getTickCount();
+
+    vector<int> thresholds;
+    if( method == "otsu" )
+    { thresholds.push_back( tut::otsuThreshold( hist ) ); }
+    else if( method == "triangle" )
+    { thresholds.push_back( tut::triangleThreshold( hist ) ); }
+    else
+    { thresholds = tut::multiOtsuThresholds( hist, levels ); }
+    int64 t2 = getTickCount();
+
+    // And one more to compare every pixel against every threshold
+    tut::applyLevels( src_gray, dst, thresholds, max_BINARY_value );
+    int64 t3 = getTickCount();
+
+    double ms = 1000. / getTickFrequency();
+    cout << method << " threshold" << (thresholds.size() > 1 ? "s:" : ":");
+    for( size_t i = 0; i < thresholds.size(); i++ )
+    { cout << " " << thresholds[i]; }
+    cout << endl;
+    printf( "histogram %.2f ms, thresholds %.2f ms, apply %.2f ms\n",
+            (t1 - t0) * ms, (t2 - t1) * ms, (t3 - t2) * ms );
+
+    // Same thing through threshold() for the two methods OpenCV has
+    if( method != "multi" )
+    {
+        Mat ref;
+        int64 r0 = getTickCount();
+        double t = threshold( src_gray, ref, 0, max_BINARY_value,
+                THRESH_BINARY | (method == "otsu" ? THRESH_OTSU : THRESH_TRIANGLE) );
+        int64 r1 = getTickCount();
+        printf( "threshold(): %g in %.2f ms, differing pixels: %d\n",
+                t, (r1 - r0) * ms, countNonZero( ref != dst ) );
+    }
+
+    bool cleaned = thresholds.size() == 1 && Clean_Mask( parser );
+
+    if( parser.has( "out" ) )
+    {
+        string out = parser.get<string>( "out" );
+        if( thresholds.size() == 1 && out.size() > 4 && out.compare( out.size() - 4, 4, ".pbm" ) == 0 )
+        {
+            tut::PackedBinary packed;
+            int64 p0 = getTickCount();
+            if( cleaned ) { tut::packThreshold( dst, packed, 0 ); }
+            else { tut::packThreshold( src_gray, packed, thresholds[0] ); }
+            int64 p1 = getTickCount();
+            printf( "packed: %.2f ms, %d bytes instead of %d\n", (p1 - p0) * ms,
+                    (int)packed.bytes(), (int)dst.total() );
+            return tut::writePackedPBM( out, packed ) ? 0 : -1;
+        }
+        return imwrite( out, dst ) ? 0 : -1;
+    }
+
+    imshow( window_name, dst );
+    waitKey( 0 );
+    return 0;
+}
+
+int Adaptive_Threshold( const CommandLineParser& parser )
+{
+    string method = parser.get<string>( "adaptive" );
+    int block = parser.get<int>( "block" );
+    double k = parser.get<double>( "k" );
+    if( (method != "bradley" && method != "sauvola") || block < 3 || block % 2 == 0 )
+    {
+        cout << "Use --adaptive=bradley or --adaptive=sauvola, with an odd --block >= 3" << endl;
+        return -1;
+    }
+    int type = method == "bradley" ? tut::LOCAL_THRESH_BRADLEY : tut::LOCAL_THRESH_SAUVOLA;
+    if( k < 0 )
+    { k = type == tut::LOCAL_THRESH_BRADLEY ? 0.15 : 0.34; }
+
+    tut::LocalThreshold local;
+    double ms = 1000. / getTickFrequency();
+
+    if( parser.has( "bench" ) )
+    {
+        // The cost of the integral image methods does not move with the
+        // block size; adaptiveThreshold's blur grows with it for the Gaussian
+        printf( "%6s %12s %12s %12s %12s\n", "block", "bradley", "sauvola", "mean_c", "gaussian_c" );
+        static const int blocks[] = { 15, 31, 63, 127, 255, 511 };
+        for( size_t i = 0; i < sizeof(blocks) / sizeof(blocks[0]); i++ )
+        {
+            int b = blocks[i];
+            Mat out;
+            double t[4];
+            for( int m = 0; m < 4; m++ )
+            {
+                int64 best = 0;
+                for( int r = 0; r < 5; r++ )
+                {
+                    int64 t0 = getTickCount();
+                    if( m == 0 )      { local.apply( src_gray, out, tut::LOCAL_THRESH_BRADLEY, b, 0.15 ); }
+                    else if( m == 1 ) { local.apply( src_gray, out, tut::LOCAL_THRESH_SAUVOLA, b, 0.34 ); }
+                    else
+                    {
+                        adaptiveThreshold( src_gray, out, max_BINARY_value,
+                                m == 2 ? ADAPTIVE_THRESH_MEAN_C : ADAPTIVE_THRESH_GAUSSIAN_C,
+                                THRESH_BINARY, b, 10 );
+                    }
+                    int64 dt = getTickCount() - t0;
+                    best = r == 0 ? dt : std::min( best, dt );
+                }
+                t[m] = best * ms;
+            }
+            printf( "%6d %9.2f ms %9.2f ms %9.2f ms %9.2f ms\n", b, t[0], t[1], t[2], t[3] );
+        }
+    }
+
+    int64 t0 = getTickCount();
+    local.apply( src_gray, dst, type, block, k, max_BINARY_value );
+    int64 t1 = getTickCount();
+    printf( "%s, block %d, k %g: %.2f ms\n", method.c_str(), block, k, (t1 - t0) * ms );
+    Clean_Mask( parser );
+
+    if( parser.has( "out" ) )
+    { return imwrite( parser.get<string>( "out" ), dst ) ? 0 : -1; }
+
+    imshow( window_name, dst );
+    waitKey( 0 );
+    return 0;
+}
+
+int Threshold_Ladder( const CommandLineParser& parser )
+{
+    // Values: a comma separated list, or one step for all its multiples
+    string list = parser.get<string>( "ladder" );
+    vector<int> values;
+    if( list.find( ',' ) == string::npos )
+    {
+        int step = atoi( list.c_str() );
+        for( int v = step; step > 0 && v <= max_value; v += step ) { values.push_back( v ); }
+    }
+    else
+    {
+        for( size_t pos = 0; pos < list.size(); )
+        {
+            size_t end = list.find( ',', pos );
+            if( end == string::npos ) { end = list.size(); }
+            values.push_back( atoi( list.substr( pos, end - pos ).c_str() ) );
+            pos = end + 1;
+        }
+    }
+
+    string type_list = parser.get<string>( "types" );
+    int type_mask = 0;
+    for( size_t i = 0; i < type_list.size(); i++ )
+    {
+        if( type_list[i] >= '0' && type_list[i] <= '0' + max_type ) { type_mask |= 1 << (type_list[i] - '0'); }
+    }
+    if( values.empty() || !type_mask )
+    {
+        cout << "Use --ladder=v1,v2,... or --ladder=step, and --types with digits 0 to 4" << endl;
+        return -1;
+    }
+
+    // One read of src_gray for every output
+    vector<Mat> outputs;
+    int64 t0 = getTickCount();
+    tut::thresholdLadder( src_gray, values, max_BINARY_value, type_mask, outputs );
+    int64 t1 = getTickCount();
+
+    // The same outputs one threshold call at a time
+    Mat single;
+    int64 t2 = getTickCount();
+    for( size_t j = 0; j < values.size(); j++ )
+    {
+        for( int type = 0; type <= max_type; type++ )
+        {
+            if( type_mask & (1 << type) )
+            { threshold( src_gray, single, values[j], max_BINARY_value, type ); }
+        }
+    }
+    int64 t3 = getTickCount();
+
+    double ms = 1000. / getTickFrequency();
+    int types = (int)outputs.size() / (int)values.size();
+    printf( "%d outputs: one pass %.2f ms, %d threshold() calls %.2f ms\n", (int)outputs.size(),
+            (t1 - t0) * ms, (int)outputs.size(), (t3 - t2) * ms );
+
+    // Grid of thumbnails, values down, types across
+    static const char* names[] = { "binary", "binary inv", "trunc", "to zero", "to zero inv" };
+    vector<int> type_ids;
+    for( int type = 0; type <= max_type; type++ )
+    {
+        if( type_mask & (1 << type) ) { type_ids.push_back( type ); }
+    }
+    int tile_w = std::min( src_gray.cols, 240 );
+    int tile_h = std::max( 1, src_gray.rows * tile_w / src_gray.cols );
+    Mat grid( tile_h * (int)values.size(), tile_w * types, CV_8UC1, Scalar::all( 0 ) );
+    for( size_t j = 0; j < values.size(); j++ )
+    {
+        for( int i = 0; i < types; i++ )
+        {
+            Mat tile = grid( Rect( i * tile_w, (int)j * tile_h, tile_w, tile_h ) );
+            resize( outputs[j * types + i], tile, tile.size(), 0, 0, INTER_AREA );
+            char label[64];
+            sprintf( label, "%s %d", names[type_ids[i]], values[j] );
+            putText( tile, label, Point( 4, 14 ), FONT_HERSHEY_SIMPLEX, 0.4, Scalar::all( 128 ), 1, 8, false );
+        }
+    }
+
+    if( parser.has( "out" ) )
+    { return imwrite( parser.get<string>( "out" ), grid ) ? 0 : -1; }
+
+    namedWindow( "Threshold ladder", CV_WINDOW_AUTOSIZE );
+    imshow( "Threshold ladder", grid );
+    waitKey( 0 );
+    return 0;
+}
+
+// Opening and closing of the binary dst with large squares, at a cost that
+// does not grow with the square. Returns true if dst was changed.
+bool Clean_Mask( const CommandLineParser& parser )
+{
+    int open_size = parser.get<int>( "open" ), close_size = parser.get<int>( "close" );
+    if( open_size <= 1 && close_size <= 1 )
+    { return false; }
+
+    tut::RectMorphology morph;
+    Mat ref;
+    double ms = 1000. / getTickFrequency();
+    for( int pass = 0; pass < 2; pass++ )
+    {
+        int size = pass == 0 ? open_size : close_size;
+        int op = pass == 0 ? MORPH_OPEN : MORPH_CLOSE;
+        if( size <= 1 ) { continue; }
+
+        Mat element = getStructuringElement( MORPH_RECT, Size( size, size ) );
+        int64 r0 = getTickCount();
+        morphologyEx( dst, ref, op, element );
+        int64 r1 = getTickCount();
+        morph.apply( dst, dst, op, Size( size, size ) );
+        int64 r2 = getTickCount();
+
+        printf( "%s %dx%d: %.2f ms, morphologyEx %.2f ms, differing pixels: %d\n",
+                pass == 0 ? "open" : "close", size, size, (r2 - r1) * ms, (r1 - r0) * ms,
+                countNonZero( ref != dst ) );
+    }
+    return true;
+}
@@ -0,0 +1,316 @@
+// Automatic global thresholds for 8-bit gray images.
+
+// Otsu, triangle and multi-level Otsu all pick their thresholds from the
+// 256-bin histogram alone, so the image is read once to build the histogram
+// and once more to apply the result:
+//   1. histogram256 - row strips in parallel, each counting 8 pixels per
+//      64-bit load into four interleaved sub-histograms (so consecutive equal
+//      pixels do not wait on each other's increment), merged at the end
+//   2. otsuThreshold / triangleThreshold / multiOtsuThresholds - work on the
+//      256 bins only, independent of the image size
+//   3. applyLevels - compares 16 pixels per SSE2 instruction against every
+//      threshold at once and writes the output level directly
+
+// otsuThreshold and triangleThreshold repeat the arithmetic of OpenCV's
+// THRESH_OTSU and THRESH_TRIANGLE, so they return the same values.
+
+#ifndef TUTORIALS_AUTO_THRESHOLD_HPP
+#define TUTORIALS_AUTO_THRESHOLD_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <string.h>
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+class Histogram256Body : public cv::ParallelLoopBody
+{
+public:
+    Histogram256Body( const cv::Mat& _src, unsigned* _partial, int _stripes )
+        : src(_src), partial(_partial), stripes(_stripes) {}
+
+    /// One iteration is one stripe of rows, counted into its own histogram.
+    void operator()( const cv::Range& range ) const
+    {
+        for( int p = range.start; p < range.end; p++ )
+        {
+            unsigned h[4][256];
+            memset( h, 0, sizeof(h) );
+            int y0 = (int)((int64)src.rows * p / stripes);
+            int y1 = (int)((int64)src.rows * (p + 1) / stripes);
+            for( int y = y0; y < y1; y++ )
+            {
+                const uchar* s = src.ptr<uchar>(y);
+                int x = 0;
+                for( ; x <= src.cols - 8; x += 8 )
+                {
+                    uint64 v;
+                    memcpy( &v, s + x, 8 );
+                    h[0][v & 255]++;         h[1][(v >> 8) & 255]++;
+                    h[2][(v >> 16) & 255]++; h[3][(v >> 24) & 255]++;
+                    h[0][(v >> 32) & 255]++; h[1][(v >> 40) & 255]++;
+                    h[2][(v >> 48) & 255]++; h[3][v >> 56]++;
+                }
+                for( ; x < src.cols; x++ )
+                { h[0][s[x]]++; }
+            }
+            unsigned* out = partial + (size_t)p * 256;
+            for( int i = 0; i < 256; i++ )
+            { out[i] = h[0][i] + h[1][i] + h[2][i] + h[3][i]; }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    unsigned* partial;
+    int stripes;
+};
+
+/// Histogram of an 8-bit single channel image.
+inline void histogram256( const cv::Mat& src, unsigned hist[256] )
+{
+    CV_Assert( src.type() == CV_8UC1 );
+    int stripes = std::max( 1, std::min( src.rows, cv::getNumThreads() * 4 ) );
+    std::vector<unsigned> partial( (size_t)stripes * 256 );
+    cv::parallel_for_( cv::Range(0, stripes), Histogram256Body( src, &partial[0], stripes ) );
+
+    memset( hist, 0, 256 * sizeof(unsigned) );
+    for( int p = 0; p < stripes; p++ )
+    {
+        for( int i = 0; i < 256; i++ )
+        { hist[i] += partial[(size_t)p * 256 + i]; }
+    }
+}
+
+/// Otsu's threshold: the t maximizing the between-class variance of
+/// {<= t} and {> t}.
+inline int otsuThreshold( const unsigned hist[256] )
+{
+    double total = 0, mu = 0;
+    for( int i = 0; i < 256; i++ )
+    {
+        total += hist[i];
+        mu += i * (double)hist[i];
+    }
+    if( total == 0 ) { return 0; }
+    double scale = 1. / total;
+    mu *= scale;
+
+    double mu1 = 0, q1 = 0, max_sigma = 0;
+    int max_val = 0;
+    for( int i = 0; i < 256; i++ )
+    {
+        double p_i = hist[i] * scale;
+        mu1 *= q1;
+        q1 += p_i;
+        double q2 = 1. - q1;
+        if( std::min( q1, q2 ) < FLT_EPSILON || std::max( q1, q2 ) > 1. - FLT_EPSILON )
+        { continue; }
+        mu1 = (mu1 + i * p_i) / q1;
+        double mu2 = (mu - q1 * mu1) / q2;
+        double sigma = q1 * q2 * (mu1 - mu2) * (mu1 - mu2);
+        if( sigma > max_sigma )
+        {
+            max_sigma = sigma;
+            max_val = i;
+        }
+    }
+    return max_val;
+}
+
+/// Triangle threshold: the bin farthest from the line joining the histogram
+/// peak to the far end of its longer tail.
+inline int triangleThreshold( const unsigned hist[256] )
+{
+    const int N = 256;
+    int h[N];
+    for( int i = 0; i < N; i++ ) { h[i] = (int)hist[i]; }
+
+    int left_bound = 0, right_bound = 0, max_ind = 0, max = 0;
+    for( int i = 0; i < N; i++ )
+    {
+        if( h[i] > 0 ) { left_bound = i; break; }
+    }
+    if( left_bound > 0 ) { left_bound--; }
+    for( int i = N - 1; i > 0; i-- )
+    {
+        if( h[i] > 0 ) { right_bound = i; break; }
+    }
+    if( right_bound < N - 1 ) { right_bound++; }
+    for( int i = 0; i < N; i++ )
+    {
+        if( h[i] > max ) { max = h[i]; max_ind = i; }
+    }
+
+    bool flipped = false;
+    if( max_ind - left_bound < right_bound - max_ind )
+    {
+        flipped = true;
+        std::reverse( h, h + N );
+        left_bound = N - 1 - right_bound;
+        max_ind = N - 1 - max_ind;
+    }
+
+    double a = max, b = left_bound - max_ind, dist = 0;
+    int thresh = left_bound;
+    for( int i = left_bound + 1; i <= max_ind; i++ )
+    {
+        double d = a * i + b * h[i];
+        if( d > dist ) { dist = d; thresh = i; }
+    }
+    thresh--;
+    return flipped ? N - 1 - thresh : thresh;
+}
+
+/// Multi-level Otsu: the levels-1 thresholds t_0 < t_1 < ... splitting the
+/// histogram into `levels` classes ({<= t_0}, {t_0 < v <= t_1}, ...) with the
+/// largest between-class variance. Found exactly by dynamic programming over
+/// the bins, in O(levels * 256^2) steps, without touching the image.
+inline std::vector<int> multiOtsuThresholds( const unsigned hist[256], int levels )
+{
+    CV_Assert( levels >= 2 && levels <= 256 );
+    const int N = 256;
+    // Prefix sums of counts and of intensity * count
+    std::vector<double> P( N + 1, 0. ), S( N + 1, 0. );
+    for( int i = 0; i < N; i++ )
+    {
+        P[i + 1] = P[i] + hist[i];
+        S[i + 1] = S[i] + i * (double)hist[i];
+    }
+
+    // best[k][b]: best sum of S^2/P for bins [0, b) split into k+1 classes
+    std::vector< std::vector<double> > best( levels, std::vector<double>( N + 1, -1. ) );
+    std::vector< std::vector<int> > from( levels, std::vector<int>( N + 1, 0 ) );
+    for( int b = 1; b <= N; b++ )
+    { best[0][b] = P[b] > 0 ? S[b] * S[b] / P[b] : 0.; }
+    for( int k = 1; k < levels; k++ )
+    {
+        for( int b = k + 1; b <= N; b++ )
+        {
+            for( int a = k; a < b; a++ )
+            {
+                if( best[k - 1][a] < 0 ) { continue; }
+                double p = P[b] - P[a], s = S[b] - S[a];
+                double v = best[k - 1][a] + (p > 0 ? s * s / p : 0.);
+                if( v > best[k][b] ) { best[k][b] = v; from[k][b] = a; }
+            }
+        }
+    }
+
+    std::vector<int> thresholds( levels - 1 );
+    int b = N;
+    for( int k = levels - 1; k > 0; k-- )
+    {
+        b = from[k][b];
+        thresholds[k - 1] = b - 1;
+    }
+    return thresholds;
+}
+
+class ApplyLevelsBody : public cv::ParallelLoopBody
+{
+public:
+    ApplyLevelsBody( const cv::Mat& _src, cv::Mat& _dst, const std::vector<int>& _t,
+                     const std::vector<uchar>& _steps, int _base )
+        : src(_src), dst(_dst), t(_t), steps(_steps), base(_base) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int n = (int)t.size();
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            uchar* d = dst.ptr<uchar>(y);
+            int x = 0;
+#if CV_SSE2
+            // Unsigned compare as signed after flipping the top bit
+            __m128i bias = _mm_set1_epi8( (char)0x80 );
+            __m128i vbase = _mm_set1_epi8( (char)base );
+            __m128i tv[8], sv[8];
+            int nv = std::min( n, 8 );
+            for( int k = 0; k < nv; k++ )
+            {
+                tv[k] = _mm_set1_epi8( (char)(t[k] ^ 0x80) );
+                sv[k] = _mm_set1_epi8( (char)steps[k] );
+            }
+            if( n <= 8 )
+            {
+                for( ; x <= src.cols - 16; x += 16 )
+                {
+                    __m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)(s + x) ), bias );
+                    __m128i out = vbase;
+                    for( int k = 0; k < nv; k++ )
+                    { out = _mm_add_epi8( out, _mm_and_si128( _mm_cmpgt_epi8( v, tv[k] ), sv[k] ) ); }
+                    _mm_storeu_si128( (__m128i*)(d + x), out );
+                }
+            }
+#endif
+            for( ; x < src.cols; x++ )
+            {
+                int out = base;
+                for( int k = 0; k < n; k++ )
+                {
+                    if( s[x] > t[k] ) { out += steps[k]; }
+                }
+                d[x] = (uchar)out;
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& dst;
+    const std::vector<int>& t;
+    const std::vector<uchar>& steps;
+    int base;
+};
+
+/// Maps every pixel to the class it falls in, given ascending thresholds:
+/// above none -> 0, above all -> maxval, evenly spaced in between. With one
+/// threshold this is threshold( src, dst, t, maxval, THRESH_BINARY ).
+inline void applyLevels( const cv::Mat& src, cv::Mat& dst, const std::vector<int>& thresholds,
+                         int maxval = 255 )
+{
+    CV_Assert( src.type() == CV_8UC1 && !thresholds.empty() );
+    int n = (int)thresholds.size();
+    // Output of class k is round(k * maxval / n); step k is what crossing
+    // threshold k adds to it, so the output is a sum of masked steps.
+    std::vector<uchar> steps( n );
+    std::vector<int> t( n );
+    for( int k = 0; k < n; k++ )
+    {
+        steps[k] = (uchar)(cvRound( (k + 1) * maxval / (double)n ) - cvRound( k * maxval / (double)n ));
+        // Past 255 nothing can be above the threshold; below 0 everything is
+        t[k] = std::min( std::max( thresholds[k], -1 ), 255 );
+    }
+    dst.create( src.rows, src.cols, CV_8UC1 );
+
+    // A threshold of -1 or 255 cannot be compared in 8 bits: fold it into
+    // the base every pixel starts from and drop it from the per pixel work
+    std::vector<int> tt;
+    std::vector<uchar> ss;
+    int base = 0;
+    for( int k = 0; k < n; k++ )
+    {
+        if( t[k] < 0 ) { base += steps[k]; }
+        else if( t[k] < 255 ) { tt.push_back( t[k] ); ss.push_back( steps[k] ); }
+    }
+    if( tt.empty() )
+    {
+        dst.setTo( cv::Scalar::all( base ) );
+        return;
+    }
+    cv::parallel_for_( cv::Range(0, src.rows), ApplyLevelsBody( src, dst, tt, ss, base ) );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_AUTO_THRESHOLD_HPP
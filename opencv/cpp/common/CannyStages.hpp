@@ -0,0 +1,181 @@
+// Canny split into the part that depends on the thresholds and the part that
+// does not.
+
+// Canny( src, edges, low, high, 3 ) runs
+//   1. a 3x3 Sobel, dx and dy, and the L1 magnitude |dx| + |dy|
+//   2. non-maximum suppression: a pixel stays only if its magnitude is a
+//      maximum across the edge, along the gradient direction rounded to
+//      0, 45, 90 or 135 degrees
+//   3. hysteresis: the remaining pixels above high are edges, and so are
+//      those above low 8-connected to an edge
+// Only step 3 reads the thresholds. Steps 1 and 2 are kept here as one image
+// of the surviving magnitudes (0 where suppressed), computed once per image;
+// then every new pair of thresholds only costs the hysteresis pass.
+
+// The direction test and its tie breaking are those of Canny, as is the
+// border: replicated for the Sobel, magnitude 0 outside the image.
+
+#ifndef TUTORIALS_CANNY_STAGES_HPP
+#define TUTORIALS_CANNY_STAGES_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <stdlib.h>
+#include <vector>
+
+namespace tut
+{
+
+class CannyNmsBody : public cv::ParallelLoopBody
+{
+public:
+    CannyNmsBody( const cv::Mat& _dx, const cv::Mat& _dy, cv::Mat& _nms )
+        : dx(_dx), dy(_dy), nms(_nms) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        // tan(22.5 degrees) in 15 bit fixed point, as in Canny
+        const int SHIFT = 15;
+        const int TG22 = (int)(0.4142135623730950488016887242097 * (1 << SHIFT) + 0.5);
+        int width = dx.cols;
+        // Magnitude of rows y-1, y, y+1, with a 0 on each side
+        std::vector<int> buf( (width + 2) * 3, 0 );
+        int* rows[3] = { &buf[1], &buf[width + 3], &buf[2 * width + 5] };
+
+        magnitudeRow( range.start - 1, rows[0] );
+        magnitudeRow( range.start, rows[1] );
+        for( int y = range.start; y < range.end; y++ )
+        {
+            magnitudeRow( y + 1, rows[2] );
+            const short* sx = dx.ptr<short>(y);
+            const short* sy = dy.ptr<short>(y);
+            const int* up = rows[0];
+            const int* mag = rows[1];
+            const int* down = rows[2];
+            ushort* d = nms.ptr<ushort>(y);
+
+            for( int x = 0; x < width; x++ )
+            {
+                int m = mag[x];
+                bool keep = false;
+                if( m > 0 )
+                {
+                    int xs = sx[x], ys = sy[x];
+                    int ax = abs( xs ), ay = abs( ys ) << SHIFT;
+                    int tg22x = ax * TG22;
+                    if( ay < tg22x )
+                    { keep = m > mag[x - 1] && m >= mag[x + 1]; }
+                    else if( ay > tg22x + (ax << (SHIFT + 1)) )
+                    { keep = m > up[x] && m >= down[x]; }
+                    else
+                    {
+                        int s = (xs ^ ys) < 0 ? -1 : 1;
+                        keep = m > up[x - s] && m > down[x + s];
+                    }
+                }
+                d[x] = keep ? (ushort)m : 0;
+            }
+
+            int* t = rows[0];
+            rows[0] = rows[1];
+            rows[1] = rows[2];
+            rows[2] = t;
+        }
+    }
+
+private:
+    void magnitudeRow( int y, int* row ) const
+    {
+        if( (unsigned)y >= (unsigned)dx.rows )
+        {
+            memset( row, 0, dx.cols * sizeof(int) );
+            return;
+        }
+        const short* sx = dx.ptr<short>(y);
+        const short* sy = dy.ptr<short>(y);
+        for( int x = 0; x < dx.cols; x++ ) { row[x] = abs( sx[x] ) + abs( sy[x] ); }
+    }
+
+    const cv::Mat& dx;
+    const cv::Mat& dy;
+    cv::Mat& nms;
+};
+
+/// Canny with aperture 3 and the L1 gradient, in two stages:
+///   setImage( src )            Sobel and non-maximum suppression, once
+///   edges( low, high, dst )    hysteresis only, as often as needed
+/// edges gives the same image as Canny( src, dst, low, high, 3 ).
+class CannyStages
+{
+public:
+    void setImage( const cv::Mat& src )
+    {
+        CV_Assert( src.type() == CV_8UC1 );
+        cv::Sobel( src, dx, CV_16S, 1, 0, 3, 1, 0, cv::BORDER_REPLICATE );
+        cv::Sobel( src, dy, CV_16S, 0, 1, 3, 1, 0, cv::BORDER_REPLICATE );
+        nms.create( src.rows, src.cols, CV_16UC1 );
+        cv::parallel_for_( cv::Range(0, src.rows), CannyNmsBody( dx, dy, nms ),
+                std::max( 1, src.rows / 32 ) );
+    }
+
+    bool empty() const { return nms.empty(); }
+
+    /// Magnitudes left after non-maximum suppression, CV_16UC1.
+    const cv::Mat& maxima() const { return nms; }
+
+    void edges( double low_thresh, double high_thresh, cv::Mat& dst )
+    {
+        CV_Assert( !nms.empty() );
+        if( low_thresh > high_thresh ) { std::swap( low_thresh, high_thresh ); }
+        // Suppressed pixels hold 0 and kept ones at least 1, so thresholds
+        // below 0 act as 0
+        int low = std::max( cvFloor( low_thresh ), 0 );
+        int high = std::max( cvFloor( high_thresh ), 0 );
+        int width = nms.cols, height = nms.rows;
+
+        dst.create( height, width, CV_8UC1 );
+        dst = cv::Scalar::all( 0 );
+        stack.clear();
+        for( int y = 0; y < height; y++ )
+        {
+            const ushort* m = nms.ptr<ushort>(y);
+            uchar* d = dst.ptr<uchar>(y);
+            for( int x = 0; x < width; x++ )
+            {
+                if( m[x] <= high || d[x] ) { continue; }
+                d[x] = 255;
+                stack.push_back( cv::Point( x, y ) );
+                // Grow through the pixels above low
+                while( !stack.empty() )
+                {
+                    cv::Point p = stack.back();
+                    stack.pop_back();
+                    int y0 = std::max( p.y - 1, 0 ), y1 = std::min( p.y + 1, height - 1 );
+                    int x0 = std::max( p.x - 1, 0 ), x1 = std::min( p.x + 1, width - 1 );
+                    for( int yy = y0; yy <= y1; yy++ )
+                    {
+                        const ushort* mm = nms.ptr<ushort>(yy);
+                        uchar* dd = dst.ptr<uchar>(yy);
+                        for( int xx = x0; xx <= x1; xx++ )
+                        {
+                            if( mm[xx] > low && !dd[xx] )
+                            {
+                                dd[xx] = 255;
+                                stack.push_back( cv::Point( xx, yy ) );
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    cv::Mat dx, dy, nms;
+    std::vector<cv::Point> stack;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_CANNY_STAGES_HPP
@@ -0,0 +1,120 @@
+// Contours stored flat: all points in one array, where each contour starts in
+// a second one.
+
+// vector< vector<Point> > costs one heap block per contour, allocated again
+// every frame, and scatters the points over the heap. A ContourArena keeps
+//   points      every contour's points, one contour after the other
+//   offsets     contour i is points[offsets[i]] .. points[offsets[i + 1] - 1]
+//   hierarchy   next, previous, first child, parent, as from findContours
+// and clear() keeps the capacity of all three, so once a frame of the usual
+// size has been seen, filling the arena again allocates nothing.
+
+// contour( i ) wraps contour i in a Mat header without copying, which is
+// all convexHull, contourArea, boundingRect... need. drawContours and
+// convexHulls below do the same for whole arenas.
+
+#ifndef TUTORIALS_CONTOUR_ARENA_HPP
+#define TUTORIALS_CONTOUR_ARENA_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <climits>
+#include <vector>
+
+namespace tut
+{
+
+class ContourArena
+{
+public:
+    ContourArena() : offsets( 1, 0 ) {}
+
+    void clear()
+    {
+        points.clear();
+        offsets.assign( 1, 0 );
+        hierarchy.clear();
+    }
+
+    /// Number of contours.
+    int size() const { return (int)offsets.size() - 1; }
+    bool empty() const { return size() == 0; }
+    /// Number of points, all contours together.
+    int total() const { return offsets.back(); }
+
+    int length( int i ) const { return offsets[i + 1] - offsets[i]; }
+    const cv::Point* begin( int i ) const { return data() + offsets[i]; }
+    const cv::Point* end( int i ) const { return data() + offsets[i + 1]; }
+
+    /// Contour i as an n x 1 CV_32SC2 Mat over the arena's points, valid
+    /// until the arena changes.
+    cv::Mat contour( int i ) const
+    { return cv::Mat( length( i ), 1, CV_32SC2, (void*)begin( i ) ); }
+
+    /// Appends a contour.
+    void add( const cv::Point* pts, int n )
+    {
+        points.insert( points.end(), pts, pts + n );
+        offsets.push_back( (int)points.size() );
+    }
+    void add( const std::vector<cv::Point>& pts )
+    { add( pts.empty() ? 0 : &pts[0], (int)pts.size() ); }
+
+    /// Mat headers of every contour, for calls taking an array of contours.
+    void views( std::vector<cv::Mat>& mats ) const
+    {
+        mats.resize( size() );
+        for( int i = 0; i < size(); i++ ) { mats[i] = contour( i ); }
+    }
+
+    const cv::Point* data() const { return points.empty() ? 0 : &points[0]; }
+
+    /// Copies out as vector< vector<Point> >.
+    void copyTo( std::vector< std::vector<cv::Point> >& contours ) const
+    {
+        contours.resize( size() );
+        for( int i = 0; i < size(); i++ ) { contours[i].assign( begin( i ), end( i ) ); }
+    }
+
+    std::vector<cv::Point> points;
+    std::vector<int> offsets;
+    std::vector<cv::Vec4i> hierarchy;
+};
+
+/// cv::drawContours for an arena, with its own hierarchy. Drawing a single
+/// contour (maxLevel 0, or no hierarchy) hands drawContours that contour
+/// only, instead of all of them to pick one from.
+inline void drawContours( cv::Mat& image, const ContourArena& contours, int contourIdx,
+                          const cv::Scalar& color, int thickness = 1, int lineType = 8,
+                          int maxLevel = INT_MAX, cv::Point offset = cv::Point() )
+{
+    if( contourIdx >= 0 && (maxLevel == 0 || contours.hierarchy.empty()) )
+    {
+        std::vector<cv::Mat> one( 1, contours.contour( contourIdx ) );
+        cv::drawContours( image, one, 0, color, thickness, lineType, cv::noArray(), 0, offset );
+        return;
+    }
+    std::vector<cv::Mat> all;
+    contours.views( all );
+    if( contours.hierarchy.empty() )
+    { cv::drawContours( image, all, contourIdx, color, thickness, lineType, cv::noArray(), maxLevel, offset ); }
+    else
+    { cv::drawContours( image, all, contourIdx, color, thickness, lineType, contours.hierarchy, maxLevel, offset ); }
+}
+
+/// convexHull of every contour, hull i for contour i, as points. The
+/// hulls' hierarchy is left empty.
+inline void convexHulls( const ContourArena& contours, ContourArena& hulls, bool clockwise = false )
+{
+    hulls.clear();
+    std::vector<cv::Point> hull;
+    for( int i = 0; i < contours.size(); i++ )
+    {
+        cv::convexHull( contours.contour( i ), hull, clockwise, true );
+        hulls.add( hull );
+    }
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_CONTOUR_ARENA_HPP
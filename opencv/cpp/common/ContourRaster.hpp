@@ -0,0 +1,178 @@
+// Draws many contours at once, on all threads, with the pixels drawContours
+// would give them (1 pixel wide, LINE_8).
+
+// drawContours draws each edge as a Bresenham line: from its left end, one
+// step a pixel along the longer axis, and a step along the shorter one
+// whenever the error term goes negative. After k steps the shorter axis has
+// therefore moved
+//   m(k) = ceil( (2 B k - A) / 2A )        A, B: the longer and shorter extent
+// so a line can be entered at any row without walking to it.
+
+// A ContourRasterizer collects contours and colors, then on draw() bins
+// every edge into the bands of rows ("tiles") it crosses, keeping the order
+// the contours were added in. Tiles are drawn in parallel; within a tile the
+// edges go in that order, so where contours overlap the last one added wins,
+// as with one drawContours call after the other.
+
+#ifndef TUTORIALS_CONTOUR_RASTER_HPP
+#define TUTORIALS_CONTOUR_RASTER_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "ContourArena.hpp"
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+namespace tut
+{
+
+/// Pixels of the LINE_8 line a - b (as cv::line draws it) in rows y0..y1-1,
+/// set to color, a pixel of image.elemSize() bytes.
+inline void rasterLineRows( cv::Mat& image, cv::Point a, cv::Point b, const uchar* color, int y0, int y1 )
+{
+    // Drawn from the left end; vertical lines from a
+    if( b.x < a.x ) { std::swap( a, b ); }
+    int dx = b.x - a.x, dy = abs( b.y - a.y ), sy = b.y < a.y ? -1 : 1;
+    bool steep = dy > dx;
+    int64 A = steep ? dy : dx, B = steep ? dx : dy;
+
+    // Rows as steps away from a, clipped to the tile
+    int lo = std::max( sy > 0 ? y0 - a.y : a.y - (y1 - 1), 0 );
+    int hi = std::min( sy > 0 ? y1 - 1 - a.y : a.y - y0, dy );
+    if( lo > hi ) { return; }
+
+    // First step k in the tile, and m = m(k)
+    int64 k;
+    if( steep ) { k = lo; }
+    else { k = lo > 0 ? (2 * A * (lo - 1) + A) / (2 * B) + 1 : 0; }
+    int64 m = A > 0 ? (2 * B * k + A - 1) / (2 * A) : 0;
+    int64 err = A - 2 * B * (k + 1) + 2 * A * m;
+
+    size_t esz = image.elemSize();
+    for( ; k <= A; k++ )
+    {
+        int row = (int)(steep ? k : m);
+        if( row > hi ) { break; }
+        int x = a.x + (int)(steep ? m : k);
+        uchar* d = image.ptr<uchar>(a.y + sy * row) + x * esz;
+        for( size_t c = 0; c < esz; c++ ) { d[c] = color[c]; }
+        if( err < 0 )
+        {
+            m++;
+            err += 2 * A;
+        }
+        err -= 2 * B;
+    }
+}
+
+class RasterTilesBody : public cv::ParallelLoopBody
+{
+public:
+    struct Polyline
+    {
+        const cv::Point* pts;
+        int n;
+        uchar color[4];
+    };
+
+    RasterTilesBody( const std::vector<Polyline>& _lines, const std::vector<int>& _edges,
+                     const std::vector<int>& _starts, int _tile_rows, cv::Mat& _image )
+        : lines(_lines), edges(_edges), starts(_starts), tile_rows(_tile_rows), image(_image) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int t = range.start; t < range.end; t++ )
+        {
+            int y0 = t * tile_rows, y1 = std::min( y0 + tile_rows, image.rows );
+            // Edge e of tile t: polyline edges[2e], edge edges[2e + 1], which
+            // runs from the point before to that point
+            for( int e = starts[t]; e < starts[t + 1]; e++ )
+            {
+                const Polyline& l = lines[edges[2 * e]];
+                int j = edges[2 * e + 1];
+                rasterLineRows( image, l.pts[j > 0 ? j - 1 : l.n - 1], l.pts[j], l.color, y0, y1 );
+            }
+        }
+    }
+
+private:
+    const std::vector<Polyline>& lines;
+    const std::vector<int>& edges;
+    const std::vector<int>& starts;
+    int tile_rows;
+    cv::Mat& image;
+};
+
+/// Batched drawContours( image, contours, i, color, 1, LINE_8 ): add() any
+/// number of closed contours, then draw() them all. The points are read by
+/// draw(), so they must stay in place until then, and lie inside the image.
+/// Keeps its buffers between calls.
+class ContourRasterizer
+{
+public:
+    typedef RasterTilesBody::Polyline Polyline;
+
+    void clear() { lines.clear(); }
+
+    void add( const cv::Point* pts, int n, const cv::Scalar& color )
+    {
+        if( n <= 0 ) { return; }
+        Polyline l;
+        l.pts = pts;
+        l.n = n;
+        for( int c = 0; c < 4; c++ ) { l.color[c] = cv::saturate_cast<uchar>( color[c] ); }
+        lines.push_back( l );
+    }
+    void add( const ContourArena& contours, int i, const cv::Scalar& color )
+    { add( contours.begin( i ), contours.length( i ), color ); }
+
+    /// Draws everything added since clear(), with tiles of tile_rows rows.
+    void draw( cv::Mat& image, int tile_rows = 16 )
+    {
+        CV_Assert( image.depth() == CV_8U && image.channels() <= 4 && tile_rows > 0 );
+        int tiles = (image.rows + tile_rows - 1) / tile_rows;
+        starts.assign( tiles + 1, 0 );
+
+        // Edges per tile, then each tile's edges in order
+        for( int pass = 0; pass < 2; pass++ )
+        {
+            for( size_t i = 0; i < lines.size(); i++ )
+            {
+                const Polyline& l = lines[i];
+                for( int j = 0; j < l.n; j++ )
+                {
+                    cv::Point a = l.pts[j > 0 ? j - 1 : l.n - 1], b = l.pts[j];
+                    CV_Assert( (unsigned)b.x < (unsigned)image.cols && (unsigned)b.y < (unsigned)image.rows );
+                    int t0 = std::min( a.y, b.y ) / tile_rows, t1 = std::max( a.y, b.y ) / tile_rows;
+                    for( int t = t0; t <= t1; t++ )
+                    {
+                        if( pass == 0 ) { starts[t + 1]++; }
+                        else
+                        {
+                            int e = fill[t]++;
+                            edges[2 * e] = (int)i;
+                            edges[2 * e + 1] = j;
+                        }
+                    }
+                }
+            }
+            if( pass == 0 )
+            {
+                for( int t = 0; t < tiles; t++ ) { starts[t + 1] += starts[t]; }
+                fill.assign( starts.begin(), starts.end() - 1 );
+                edges.resize( 2 * (size_t)starts[tiles] );
+            }
+        }
+
+        cv::parallel_for_( cv::Range(0, tiles), RasterTilesBody( lines, edges, starts, tile_rows, image ) );
+    }
+
+private:
+    std::vector<Polyline> lines;
+    std::vector<int> edges, starts, fill;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_CONTOUR_RASTER_HPP
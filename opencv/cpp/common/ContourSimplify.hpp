@@ -0,0 +1,200 @@
+// Douglas-Peucker simplification of every contour of an arena, in parallel.
+
+// Douglas-Peucker keeps a polyline's two ends, finds the point farthest from
+// the line between them and, if it is farther than epsilon, keeps it too
+// and does the same on both halves. Written as recursion, or with a stack of
+// the halves still to do as approxPolyDP does, it needs memory of its own. The
+// halves are always taken left first, so the pending ones are exactly the
+// stretches between the points already kept further right: with one mark
+// per point, the next stretch to look at always runs from the current
+// point to the next marked one. The marks are the only state, and a walk
+// from left to right does the whole job:
+//   start at the first point; end = next marked point
+//   farthest point of start..end too far: mark it, it is the new end
+//   else: start = end
+// Finding the end costs the same walk as looking for the farthest point,
+// so the total is the same as with recursion.
+
+// A closed contour is first split at its first point and the point farthest
+// from it, both kept, and the first point is repeated at the end.
+
+// Contours are independent, so they are simplified in parallel, the marks
+// of all of them in one buffer kept between calls; the points kept are
+// then gathered into the output arena.
+
+#ifndef TUTORIALS_CONTOUR_SIMPLIFY_HPP
+#define TUTORIALS_CONTOUR_SIMPLIFY_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "ContourArena.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace tut
+{
+
+/// Douglas-Peucker on pts[0..n-1] with tolerance epsilon, setting keep[j]
+/// for the points kept; keep needs room for n + 1 marks. Returns how many
+/// points are kept. A closed contour within epsilon of its first point
+/// comes down to that point alone.
+inline int douglasPeuckerMarks( const cv::Point* pts, int n, bool closed, double epsilon, uchar* keep )
+{
+    if( n <= 2 )
+    {
+        std::fill( keep, keep + n, 1 );
+        return n;
+    }
+    std::fill( keep, keep + n + 1, 0 );
+    double eps2 = epsilon * epsilon;
+    // Point j, with pts[0] again as point n of a closed contour
+    int last = n - 1;
+    if( closed )
+    {
+        int64 max_d2 = 0;
+        int far = 0;
+        for( int j = 1; j < n; j++ )
+        {
+            int64 dx = pts[j].x - pts[0].x, dy = pts[j].y - pts[0].y;
+            int64 d2 = dx * dx + dy * dy;
+            if( d2 > max_d2 )
+            {
+                max_d2 = d2;
+                far = j;
+            }
+        }
+        keep[0] = 1;
+        if( (double)max_d2 <= eps2 ) { return 1; }
+        keep[far] = 1;
+        last = n;
+    }
+    keep[0] = keep[last] = 1;
+
+    int kept = 2, start = 0;
+    while( start < last )
+    {
+        int end = start + 1;
+        while( !keep[end] ) { end++; }
+        if( end - start > 1 )
+        {
+            cv::Point a = pts[start], b = pts[end < n ? end : 0];
+            int64 dx = b.x - a.x, dy = b.y - a.y;
+            int64 max_d = -1;
+            int far = start;
+            for( int j = start + 1; j < end; j++ )
+            {
+                int64 px = pts[j].x - a.x, py = pts[j].y - a.y;
+                // |cross| is the distance to the line times its length;
+                // when both ends are the same point, the squared distance
+                int64 c = px * dy - py * dx;
+                int64 d = dx || dy ? (c < 0 ? -c : c) : px * px + py * py;
+                if( d > max_d )
+                {
+                    max_d = d;
+                    far = j;
+                }
+            }
+            double len2 = (double)(dx * dx + dy * dy);
+            double d = (double)max_d;
+            if( dx || dy ? d * d > eps2 * len2 : d > eps2 )
+            {
+                keep[far] = 1;
+                kept++;
+                continue;
+            }
+        }
+        start = end;
+    }
+    return kept;
+}
+
+class DouglasPeuckerBody : public cv::ParallelLoopBody
+{
+public:
+    DouglasPeuckerBody( const ContourArena& _contours, double _epsilon, bool _closed,
+                        std::vector<uchar>& _keep, std::vector<int>& _count )
+        : contours(_contours), epsilon(_epsilon), closed(_closed), keep(_keep), count(_count) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        // Contour i's marks start at offsets[i] + i
+        for( int i = range.start; i < range.end; i++ )
+        {
+            count[i] = douglasPeuckerMarks( contours.begin( i ), contours.length( i ), closed, epsilon,
+                                            &keep[0] + contours.offsets[i] + i );
+        }
+    }
+
+private:
+    const ContourArena& contours;
+    double epsilon;
+    bool closed;
+    std::vector<uchar>& keep;
+    std::vector<int>& count;
+};
+
+class GatherKeptBody : public cv::ParallelLoopBody
+{
+public:
+    GatherKeptBody( const ContourArena& _contours, const std::vector<uchar>& _keep, ContourArena& _approx )
+        : contours(_contours), keep(_keep), approx(_approx) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int i = range.start; i < range.end; i++ )
+        {
+            const cv::Point* pts = contours.begin( i );
+            const uchar* k = &keep[0] + contours.offsets[i] + i;
+            cv::Point* d = &approx.points[0] + approx.offsets[i];
+            for( int j = 0, n = contours.length( i ); j < n; j++ )
+            {
+                if( k[j] ) { *d++ = pts[j]; }
+            }
+        }
+    }
+
+private:
+    const ContourArena& contours;
+    const std::vector<uchar>& keep;
+    ContourArena& approx;
+};
+
+/// Douglas-Peucker with tolerance epsilon on every contour of an arena, into
+/// another one; closed contours by default, as from findContours. The
+/// hierarchy is copied over. Keeps its buffers between calls, and the
+/// output arena its capacity, so once both have grown nothing is allocated.
+class ContourSimplifier
+{
+public:
+    void simplify( const ContourArena& contours, ContourArena& approx, double epsilon, bool closed = true )
+    {
+        CV_Assert( epsilon >= 0 && &contours != &approx );
+        int n = contours.size();
+        keep.resize( (size_t)contours.total() + n );
+        count.resize( n );
+        cv::parallel_for_( cv::Range(0, n), DouglasPeuckerBody( contours, epsilon, closed, keep, count ),
+                std::max( 1, n / 64 ) );
+
+        approx.offsets.resize( n + 1 );
+        approx.offsets[0] = 0;
+        for( int i = 0; i < n; i++ ) { approx.offsets[i + 1] = approx.offsets[i] + count[i]; }
+        approx.points.resize( approx.offsets[n] );
+        approx.hierarchy.assign( contours.hierarchy.begin(), contours.hierarchy.end() );
+        cv::parallel_for_( cv::Range(0, n), GatherKeptBody( contours, keep, approx ), std::max( 1, n / 64 ) );
+    }
+
+private:
+    std::vector<uchar> keep;
+    std::vector<int> count;
+};
+
+/// One-shot version of ContourSimplifier::simplify.
+inline void simplifyContours( const ContourArena& contours, ContourArena& approx, double epsilon, bool closed = true )
+{
+    ContourSimplifier simplifier;
+    simplifier.simplify( contours, approx, epsilon, closed );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_CONTOUR_SIMPLIFY_HPP
@@ -0,0 +1,111 @@
+// Area, perimeter, bounding box and moments of a contour, gathered point by
+// point as the contour is produced.
+
+// The usual follow-up to findContours, contourArea + arcLength +
+// boundingRect + moments, reads every contour four more times. All four are
+// sums over the edges of the closed polygon, so they can be kept up to date
+// while a tracer emits the points instead: Green's theorem for the area and
+// the moments (the formulas of cv::moments), Euclidean edge lengths for the
+// perimeter, and a running min / max for the box.
+
+#ifndef TUTORIALS_CONTOUR_STATS_HPP
+#define TUTORIALS_CONTOUR_STATS_HPP
+
+#include "opencv2/core/core.hpp"
+#include <float.h>
+#include <math.h>
+
+namespace tut
+{
+
+struct ContourStats
+{
+    double area;                            // contourArea( contour )
+    double perimeter;                       // arcLength( contour, true )
+    cv::Rect bbox;                          // boundingRect( contour )
+    double m00, m10, m01, m20, m11, m02;    // moments( contour ), up to order 2
+
+    /// Center of mass, or the box corner for contours without area.
+    cv::Point2d centroid() const
+    { return m00 != 0 ? cv::Point2d( m10 / m00, m01 / m00 ) : cv::Point2d( bbox.x, bbox.y ); }
+};
+
+/// Feed the points of a closed contour in order: start( first ), add( p )
+/// for each following one, then finish.
+class ContourStatsAccumulator
+{
+public:
+    void start( cv::Point p )
+    {
+        first = prev = p;
+        a00 = a10 = a01 = a20 = a11 = a02 = 0;
+        perimeter = 0;
+        tl = br = p;
+    }
+
+    void add( cv::Point p )
+    {
+        edge( prev, p );
+        prev = p;
+        tl.x = std::min( tl.x, p.x );
+        tl.y = std::min( tl.y, p.y );
+        br.x = std::max( br.x, p.x );
+        br.y = std::max( br.y, p.y );
+    }
+
+    void finish( ContourStats& st )
+    {
+        if( prev != first ) { edge( prev, first ); }
+        st.perimeter = perimeter;
+        st.bbox = cv::Rect( tl.x, tl.y, br.x - tl.x + 1, br.y - tl.y + 1 );
+
+        // As cv::moments: scaled by the orientation, 0 when there is no area
+        if( fabs( a00 ) > FLT_EPSILON )
+        {
+            double sign = a00 > 0 ? 1. : -1.;
+            st.m00 = sign * a00 / 2;
+            st.m10 = sign * a10 / 6;
+            st.m01 = sign * a01 / 6;
+            st.m20 = sign * a20 / 12;
+            st.m11 = sign * a11 / 24;
+            st.m02 = sign * a02 / 12;
+        }
+        else
+        { st.m00 = st.m10 = st.m01 = st.m20 = st.m11 = st.m02 = 0; }
+        st.area = fabs( a00 ) / 2;
+    }
+
+private:
+    void edge( cv::Point a, cv::Point b )
+    {
+        double xi_1 = a.x, yi_1 = a.y, xi = b.x, yi = b.y;
+        double dxy = xi_1 * yi - xi * yi_1;
+        double xii_1 = xi_1 + xi, yii_1 = yi_1 + yi;
+        a00 += dxy;
+        a10 += dxy * xii_1;
+        a01 += dxy * yii_1;
+        a20 += dxy * (xi_1 * xii_1 + xi * xi);
+        a11 += dxy * (xi_1 * (yii_1 + yi_1) + xi * (yii_1 + yi));
+        a02 += dxy * (yi_1 * yii_1 + yi * yi);
+        float dx = (float)(b.x - a.x), dy = (float)(b.y - a.y);
+        perimeter += sqrtf( dx * dx + dy * dy );
+    }
+
+    cv::Point first, prev, tl, br;
+    double a00, a10, a01, a20, a11, a02;
+    double perimeter;
+};
+
+/// Statistics of a contour that is already traced.
+inline void contourStats( const cv::Point* pts, int n, ContourStats& st )
+{
+    CV_Assert( n > 0 );
+    ContourStatsAccumulator acc;
+    acc.start( pts[0] );
+    for( int i = 1; i < n; i++ ) { acc.add( pts[i] ); }
+    acc.finish( st );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_CONTOUR_STATS_HPP
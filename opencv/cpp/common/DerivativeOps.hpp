@@ -0,0 +1,339 @@
+// Compile time specialized derivative operators: Sobel 3/5/7, Scharr and
+// Laplacian 1/3/5, picked at run time from a table.
+
+// Every one of these kernels is separable, or a sum of two separable terms
+// (the Laplacian is d2/dx2 + d2/dy2), so an operator is just a few lists of
+// taps. The taps are template arguments,
+//   Taps<1, 2, 1>              smoothing of the 3x3 Sobel
+//   Taps<-1, -4, -5, 0, 5, 4, 1>  first derivative of the 7x7 Sobel
+// so each operator gets its own instantiation in which the loops over taps
+// are unrolled, zero taps generate no code and taps of +-1 need no multiply.
+
+// Each source row is filtered horizontally into int16 (the largest sum,
+// 255 * 64, still fits), a ring buffer keeps the last ksize such rows, and
+// the vertical taps combine them in int32 SSE2 lanes. The result is
+// saturated to CV_16S, which is what Sobel, Scharr and Laplacian give with
+// ddepth = CV_16S. Borders are BORDER_REFLECT_101, the OpenCV default.
+
+#ifndef TUTORIALS_DERIVATIVE_OPS_HPP
+#define TUTORIALS_DERIVATIVE_OPS_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// A list of filter taps, fixed at compile time.
+template<int... T> struct Taps
+{
+    static const int size = sizeof...(T);
+};
+
+/// Unrolled sum of tap * input, over the taps from index I on.
+/// f(i) gives the input under tap i: a row of int16 for the horizontal
+/// pass, the ring buffer row i for the vertical one.
+template<int I, int... T> struct TapDot;
+
+template<int I> struct TapDot<I>
+{
+    template<class F> static int scalar( const F& ) { return 0; }
+#if CV_SSE2
+    template<class F> static __m128i sse16( const F&, __m128i acc ) { return acc; }
+    template<class F> static void sse32( const F&, __m128i&, __m128i& ) {}
+#endif
+};
+
+template<int I, int H, int... T> struct TapDot<I, H, T...>
+{
+    template<class F> static int scalar( const F& f )
+    { return (H == 0 ? 0 : H * f(I)) + TapDot<I + 1, T...>::scalar( f ); }
+
+#if CV_SSE2
+    /// acc += H * f(I) on 8 int16 lanes, for inputs whose sums stay in int16
+    template<class F> static __m128i sse16( const F& f, __m128i acc )
+    {
+        if( H == 1 ) { acc = _mm_add_epi16( acc, f(I) ); }
+        else if( H == -1 ) { acc = _mm_sub_epi16( acc, f(I) ); }
+        else if( H != 0 ) { acc = _mm_add_epi16( acc, _mm_mullo_epi16( f(I), _mm_set1_epi16( (short)H ) ) ); }
+        return TapDot<I + 1, T...>::sse16( f, acc );
+    }
+
+    /// lo, hi += H * f(I), 8 int16 inputs widened to two sets of 4 int32
+    template<class F> static void sse32( const F& f, __m128i& lo, __m128i& hi )
+    {
+        if( H != 0 )
+        {
+            __m128i v = f(I);
+            __m128i pl, ph;
+            if( H == 1 || H == -1 )
+            {
+                pl = _mm_srai_epi32( _mm_unpacklo_epi16( v, v ), 16 );
+                ph = _mm_srai_epi32( _mm_unpackhi_epi16( v, v ), 16 );
+            }
+            else
+            {
+                __m128i c = _mm_set1_epi16( (short)H );
+                __m128i ml = _mm_mullo_epi16( v, c ), mh = _mm_mulhi_epi16( v, c );
+                pl = _mm_unpacklo_epi16( ml, mh );
+                ph = _mm_unpackhi_epi16( ml, mh );
+            }
+            if( H == -1 ) { lo = _mm_sub_epi32( lo, pl ); hi = _mm_sub_epi32( hi, ph ); }
+            else { lo = _mm_add_epi32( lo, pl ); hi = _mm_add_epi32( hi, ph ); }
+        }
+        TapDot<I + 1, T...>::sse32( f, lo, hi );
+    }
+#endif
+};
+
+template<class Tp> struct TapsOf;
+template<int... T> struct TapsOf< Taps<T...> >
+{
+    typedef TapDot<0, T...> Dot;
+};
+
+/// Loads of the horizontal pass: padded 8-bit row, widened to int16
+struct HorizontalInput
+{
+    const uchar* p;
+    int operator()( int i ) const { return p[i]; }
+};
+#if CV_SSE2
+struct HorizontalInput8
+{
+    const uchar* p;
+    __m128i operator()( int i ) const
+    { return _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(p + i) ), _mm_setzero_si128() ); }
+};
+#endif
+
+/// Loads of the vertical pass: row i of the ring buffer, at column x
+struct VerticalInput
+{
+    const short* const* rows;
+    int x;
+    int operator()( int i ) const { return rows[i][x]; }
+};
+#if CV_SSE2
+struct VerticalInput8
+{
+    const short* const* rows;
+    int x;
+    __m128i operator()( int i ) const { return _mm_loadu_si128( (const __m128i*)(rows[i] + x) ); }
+};
+#endif
+
+/// dst = Y1 * (X1 * src) + Y2 * (X2 * src), where * is a 1D correlation
+/// along the rows for X and along the columns for Y. An empty X2/Y2 pair
+/// leaves out the second term.
+template<class X1, class Y1, class X2 = Taps<>, class Y2 = Taps<> >
+class SeparableDerivBody : public cv::ParallelLoopBody
+{
+public:
+    enum { K = X1::size, R = X1::size / 2, TERMS = X2::size ? 2 : 1 };
+
+    SeparableDerivBody( const cv::Mat& _src, cv::Mat& _dst ) : src(_src), dst(_dst) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols;
+        std::vector<uchar> padded( width + 2 * R + 8 );
+        std::vector<short> ring( (size_t)TERMS * K * width );
+        std::vector<int> xofs( 2 * R );
+        for( int i = 0; i < R; i++ )
+        {
+            xofs[i] = cv::borderInterpolate( i - R, width, cv::BORDER_REFLECT_101 );
+            xofs[R + i] = cv::borderInterpolate( width + i, width, cv::BORDER_REFLECT_101 );
+        }
+
+        // Ring slot of source row y is (y + K*R) % K, never negative
+        for( int y = range.start - R; y < range.end + R; y++ )
+        {
+            const uchar* s = src.ptr<uchar>( cv::borderInterpolate( y, src.rows, cv::BORDER_REFLECT_101 ) );
+            memcpy( &padded[R], s, width );
+            for( int i = 0; i < R; i++ )
+            {
+                padded[i] = s[xofs[i]];
+                padded[R + width + i] = s[xofs[R + i]];
+            }
+            int slot = (y + K * R) % K;
+            horizontal<X1>( &padded[0], &ring[(size_t)slot * width], width );
+            if( TERMS == 2 )
+            { horizontal<X2>( &padded[0], &ring[(size_t)(K + slot) * width], width ); }
+
+            int oy = y - R;
+            if( oy < range.start )
+            { continue; }
+
+            const short* rows1[K];
+            const short* rows2[K];
+            for( int k = 0; k < K; k++ )
+            {
+                int sl = (oy - R + k + K * R) % K;
+                rows1[k] = &ring[(size_t)sl * width];
+                rows2[k] = &ring[(size_t)(TERMS == 2 ? K + sl : sl) * width];
+            }
+            short* d = dst.ptr<short>(oy);
+            int x = 0;
+#if CV_SSE2
+            for( ; x <= width - 8; x += 8 )
+            {
+                __m128i lo = _mm_setzero_si128(), hi = lo;
+                VerticalInput8 in1 = { rows1, x };
+                TapsOf<Y1>::Dot::sse32( in1, lo, hi );
+                if( TERMS == 2 )
+                {
+                    VerticalInput8 in2 = { rows2, x };
+                    TapsOf<Y2>::Dot::sse32( in2, lo, hi );
+                }
+                _mm_storeu_si128( (__m128i*)(d + x), _mm_packs_epi32( lo, hi ) );
+            }
+#endif
+            for( ; x < width; x++ )
+            {
+                VerticalInput in1 = { rows1, x };
+                int v = TapsOf<Y1>::Dot::scalar( in1 );
+                if( TERMS == 2 )
+                {
+                    VerticalInput in2 = { rows2, x };
+                    v += TapsOf<Y2>::Dot::scalar( in2 );
+                }
+                d[x] = cv::saturate_cast<short>( v );
+            }
+        }
+    }
+
+private:
+    template<class X> static void horizontal( const uchar* p, short* h, int width )
+    {
+        int x = 0;
+#if CV_SSE2
+        for( ; x <= width - 8; x += 8 )
+        {
+            HorizontalInput8 in = { p + x };
+            _mm_storeu_si128( (__m128i*)(h + x), TapsOf<X>::Dot::sse16( in, _mm_setzero_si128() ) );
+        }
+#endif
+        for( ; x < width; x++ )
+        {
+            HorizontalInput in = { p + x };
+            h[x] = (short)TapsOf<X>::Dot::scalar( in );
+        }
+    }
+
+    const cv::Mat& src;
+    cv::Mat& dst;
+};
+
+/// Runs one instantiation over an 8-bit gray image into CV_16S.
+template<class X1, class Y1, class X2, class Y2>
+void separableDeriv( const cv::Mat& src, cv::Mat& dst )
+{
+    CV_Assert( src.type() == CV_8UC1 && src.data != dst.data );
+    dst.create( src.rows, src.cols, CV_16SC1 );
+    cv::parallel_for_( cv::Range(0, src.rows), SeparableDerivBody<X1, Y1, X2, Y2>( src, dst ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+/// Tap sets, as getDerivKernels builds them
+typedef Taps<0, 1, 0>                    Identity3;
+typedef Taps<1, 2, 1>                    Smooth3;
+typedef Taps<1, 4, 6, 4, 1>              Smooth5;
+typedef Taps<1, 6, 15, 20, 15, 6, 1>     Smooth7;
+typedef Taps<3, 10, 3>                   ScharrSmooth;
+typedef Taps<-1, 0, 1>                   Deriv3;
+typedef Taps<-1, -2, 0, 2, 1>            Deriv5;
+typedef Taps<-1, -4, -5, 0, 5, 4, 1>     Deriv7;
+typedef Taps<1, -2, 1>                   SecondDeriv3;
+typedef Taps<1, 0, -2, 0, 1>             SecondDeriv5;
+
+/// One entry of the run time table. dx, dy and ksize are the arguments the
+/// equivalent OpenCV call takes (ksize -1 is Scharr, as for Sobel).
+struct DerivativeOperator
+{
+    const char* name;
+    int dx, dy, ksize;
+    bool laplacian;
+    void (*apply)( const cv::Mat& src, cv::Mat& dst );
+};
+
+inline const DerivativeOperator* derivativeOperators( int* count )
+{
+    static const DerivativeOperator ops[] =
+    {
+        { "sobel3_dx",  1, 0,  3, false, separableDeriv<Deriv3, Smooth3, Taps<>, Taps<> > },
+        { "sobel3_dy",  0, 1,  3, false, separableDeriv<Smooth3, Deriv3, Taps<>, Taps<> > },
+        { "sobel5_dx",  1, 0,  5, false, separableDeriv<Deriv5, Smooth5, Taps<>, Taps<> > },
+        { "sobel5_dy",  0, 1,  5, false, separableDeriv<Smooth5, Deriv5, Taps<>, Taps<> > },
+        { "sobel7_dx",  1, 0,  7, false, separableDeriv<Deriv7, Smooth7, Taps<>, Taps<> > },
+        { "sobel7_dy",  0, 1,  7, false, separableDeriv<Smooth7, Deriv7, Taps<>, Taps<> > },
+        { "scharr_dx",  1, 0, -1, false, separableDeriv<Deriv3, ScharrSmooth, Taps<>, Taps<> > },
+        { "scharr_dy",  0, 1, -1, false, separableDeriv<ScharrSmooth, Deriv3, Taps<>, Taps<> > },
+        { "laplacian1", 2, 2,  1, true,  separableDeriv<SecondDeriv3, Identity3, Identity3, SecondDeriv3> },
+        { "laplacian3", 2, 2,  3, true,  separableDeriv<SecondDeriv3, Smooth3, Smooth3, SecondDeriv3> },
+        { "laplacian5", 2, 2,  5, true,  separableDeriv<SecondDeriv5, Smooth5, Smooth5, SecondDeriv5> }
+    };
+    *count = sizeof(ops) / sizeof(ops[0]);
+    return ops;
+}
+
+/// Looks an operator up by name, null if there is no such operator.
+inline const DerivativeOperator* findDerivativeOperator( const std::string& name )
+{
+    int count;
+    const DerivativeOperator* ops = derivativeOperators( &count );
+    for( int i = 0; i < count; i++ )
+    {
+        if( name == ops[i].name ) { return &ops[i]; }
+    }
+    return 0;
+}
+
+/// The OpenCV call an operator stands in for.
+inline void opencvDerivative( const DerivativeOperator& op, const cv::Mat& src, cv::Mat& dst )
+{
+    if( op.laplacian )
+    { cv::Laplacian( src, dst, CV_16S, op.ksize ); }
+    else
+    { cv::Sobel( src, dst, CV_16S, op.dx, op.dy, op.ksize ); }
+}
+
+/// Prints the throughput of every operator in the table next to the
+/// OpenCV call it replaces, and how many output pixels differ.
+inline void benchmarkDerivativeOperators( const cv::Mat& src, int repeats = 10 )
+{
+    int count;
+    const DerivativeOperator* ops = derivativeOperators( &count );
+    double megapixels = src.total() * 1e-6;
+    cv::Mat ours, ref;
+
+    printf( "%-12s %12s %12s %10s\n", "operator", "ours MP/s", "OpenCV MP/s", "mismatch" );
+    for( int i = 0; i < count; i++ )
+    {
+        ops[i].apply( src, ours );
+        opencvDerivative( ops[i], src, ref );
+
+        int64 t0 = cv::getTickCount();
+        for( int r = 0; r < repeats; r++ ) { ops[i].apply( src, ours ); }
+        int64 t1 = cv::getTickCount();
+        for( int r = 0; r < repeats; r++ ) { opencvDerivative( ops[i], src, ref ); }
+        int64 t2 = cv::getTickCount();
+
+        double f = cv::getTickFrequency();
+        printf( "%-12s %12.1f %12.1f %10d\n", ops[i].name,
+                megapixels * repeats * f / (t1 - t0), megapixels * repeats * f / (t2 - t1),
+                cv::countNonZero( ours != ref ) );
+    }
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_DERIVATIVE_OPS_HPP
@@ -0,0 +1,221 @@
+// Four stage frame pipeline for running an edge detector on video.
+
+//   decode -> preprocess -> detect -> output
+// Each stage has its own thread, so while frame n is being encoded, frame
+// n+1 can be in the detector, n+2 in preprocessing and n+3 being decoded.
+// The pipeline's throughput is then set by its slowest stage rather than
+// by the sum of all four.
+
+// Frames travel in a fixed set of slots. A slot owns every Mat a frame
+// needs on its way through, and goes back to the decoder once the frame has
+// been written. Before the stage threads start, the first frame is decoded
+// and run through both stages once, untimed; that gives the size and type of
+// every Mat, all the slots are allocated to match, and the stages have their
+// own buffers too. From then on nothing is allocated and the fps and latency
+// only measure the steady state: each stage writes into the same buffers it
+// used the last time round.
+
+// Every frame records when each stage started and finished with it. The
+// report gives, per stage, the time spent working on a frame and the
+// latency from the end of the previous stage (which adds the time the frame
+// waited in the queue), plus the whole trip from decode to output.
+
+#ifndef TUTORIALS_FRAME_PIPELINE_HPP
+#define TUTORIALS_FRAME_PIPELINE_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/videoio.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tut
+{
+
+/// Everything one frame needs on its way through the pipeline.
+struct FrameSlot
+{
+    cv::Mat frame;      // decoded frame
+    cv::Mat gray;       // preprocessed
+    cv::Mat edges;      // detector output
+    int64 started[4];   // tick counts when each stage began
+    int64 finished[4];  // and ended with this frame
+};
+
+/// Blocking queue of slot indices; -1 marks the end of the stream.
+class SlotQueue
+{
+public:
+    void push( int slot )
+    {
+        std::lock_guard<std::mutex> lock( mutex );
+        slots.push_back( slot );
+        ready.notify_one();
+    }
+
+    int pop()
+    {
+        std::unique_lock<std::mutex> lock( mutex );
+        while( slots.empty() ) { ready.wait( lock ); }
+        int slot = slots.front();
+        slots.pop_front();
+        return slot;
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<int> slots;
+};
+
+class FramePipeline
+{
+public:
+    typedef std::function<void( FrameSlot& )> Stage;
+
+    static const int STAGES = 4;
+
+    explicit FramePipeline( int num_slots = 4 ) : slots( num_slots ) {}
+
+    /// Runs the stream to its end. A null writer, or one that is not open,
+    /// makes the output stage only count the frames.
+    void run( cv::VideoCapture& capture, cv::VideoWriter* writer,
+              const Stage& preprocess, const Stage& detect )
+    {
+        SlotQueue free_slots, decoded, preprocessed, detected;
+        busy_ticks.assign( STAGES, 0 );
+        wait_ticks.assign( STAGES, 0 );
+        wait_max.assign( STAGES, 0 );
+        latency_ticks = latency_max = wall_ticks = 0;
+        frames = 0;
+
+        // Warm up on the first frame and size every slot after it
+        FrameSlot& first = slots[0];
+        if( !capture.read( first.frame ) || first.frame.empty() ) { return; }
+        cv::Mat decoded_frame = first.frame.clone();
+        preprocess( first );
+        detect( first );
+        for( size_t i = 0; i < slots.size(); i++ )
+        {
+            slots[i].frame.create( decoded_frame.size(), decoded_frame.type() );
+            slots[i].gray.create( first.gray.size(), first.gray.type() );
+            slots[i].edges.create( first.edges.size(), first.edges.type() );
+        }
+        decoded_frame.copyTo( first.frame );
+
+        // The first frame then goes through like the others, its decode
+        // taken as instant
+        int64 start = cv::getTickCount();
+        first.started[0] = first.finished[0] = start;
+        decoded.push( 0 );
+        for( size_t i = 1; i < slots.size(); i++ ) { free_slots.push( (int)i ); }
+
+        std::thread decoder( [&]()
+        {
+            for( ;; )
+            {
+                int s = free_slots.pop();
+                FrameSlot& slot = slots[s];
+                slot.started[0] = cv::getTickCount();
+                if( !capture.read( slot.frame ) || slot.frame.empty() )
+                {
+                    decoded.push( -1 );
+                    return;
+                }
+                slot.finished[0] = cv::getTickCount();
+                decoded.push( s );
+            }
+        } );
+
+        std::thread preprocessor( [&]() { runStage( decoded, preprocessed, preprocess, 1 ); } );
+        std::thread detector( [&]() { runStage( preprocessed, detected, detect, 2 ); } );
+
+        // Output runs on this thread
+        for( ;; )
+        {
+            int s = detected.pop();
+            if( s < 0 ) { break; }
+            FrameSlot& slot = slots[s];
+            slot.started[3] = cv::getTickCount();
+            if( writer && writer->isOpened() ) { writer->write( slot.edges ); }
+            slot.finished[3] = cv::getTickCount();
+
+            for( int k = 0; k < STAGES; k++ )
+            {
+                int64 wait = slot.finished[k] - (k ? slot.finished[k - 1] : slot.started[0]);
+                busy_ticks[k] += slot.finished[k] - slot.started[k];
+                wait_ticks[k] += wait;
+                wait_max[k] = std::max( wait_max[k], wait );
+            }
+            int64 latency = slot.finished[3] - slot.started[0];
+            latency_ticks += latency;
+            latency_max = std::max( latency_max, latency );
+            frames++;
+            free_slots.push( s );
+        }
+        wall_ticks = cv::getTickCount() - start;
+
+        decoder.join();
+        preprocessor.join();
+        detector.join();
+    }
+
+    /// Sustained frame rate, then per stage the mean time at work on a frame
+    /// and the mean and worst latency since the previous stage let go of it.
+    void report() const
+    {
+        static const char* names[STAGES] = { "decode", "preprocess", "detect", "output" };
+        double ms = 1000. / cv::getTickFrequency();
+        int n = std::max( frames, 1 );
+        printf( "%d frames in %.2f s, %.1f fps sustained, %d slots\n", frames,
+                wall_ticks * ms / 1000., frames / std::max( wall_ticks * ms / 1000., 1e-9 ),
+                (int)slots.size() );
+        printf( "%-12s %10s %12s %12s\n", "stage", "busy ms", "latency ms", "max lat. ms" );
+        for( int k = 0; k < STAGES; k++ )
+        {
+            printf( "%-12s %10.2f %12.2f %12.2f\n", names[k], busy_ticks[k] * ms / n,
+                    wait_ticks[k] * ms / n, wait_max[k] * ms );
+        }
+        printf( "%-12s %10s %12.2f %12.2f\n", "end to end", "", latency_ticks * ms / n, latency_max * ms );
+    }
+
+private:
+    void runStage( SlotQueue& in, SlotQueue& out, const Stage& stage, int k )
+    {
+        for( ;; )
+        {
+            int s = in.pop();
+            if( s >= 0 )
+            {
+                slots[s].started[k] = cv::getTickCount();
+                stage( slots[s] );
+                slots[s].finished[k] = cv::getTickCount();
+            }
+            out.push( s );
+            if( s < 0 ) { return; }
+        }
+    }
+
+    std::vector<FrameSlot> slots;
+    std::vector<int64> busy_ticks, wait_ticks, wait_max;
+    int64 latency_ticks, latency_max, wall_ticks;
+    int frames;
+};
+
+/// Opens a camera when the argument is a number, a video file otherwise.
+inline bool openVideoSource( cv::VideoCapture& capture, const std::string& source )
+{
+    if( !source.empty() && source.find_first_not_of( "0123456789" ) == std::string::npos )
+    { return capture.open( atoi( source.c_str() ) ); }
+    return capture.open( source );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_FRAME_PIPELINE_HPP
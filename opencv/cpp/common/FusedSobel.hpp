@@ -0,0 +1,194 @@
+// Single pass 3x3 Sobel edge strength: 0.5*|dx| + 0.5*|dy| straight to 8 bits.
+
+// The tutorial version runs Sobel twice, convertScaleAbs twice and
+// addWeighted once, streaming the frame through memory five times and keeping
+// four full size intermediates. Here each gray row is read once.
+
+// The 3x3 Sobel kernels are separable:
+//   dx = [1 2 1]^T * [-1 0 1]      dy = [-1 0 1]^T * [1 2 1]
+// so every source row is reduced to two short rows, its horizontal
+// difference D and its horizontal smoothing S. The last three of each are
+// kept in a ring buffer, and the output row y is
+//   dx = D(y-1) + 2 D(y) + D(y+1)      dy = S(y+1) - S(y-1)
+// All of this fits in int16, so SSE2 handles 8 pixels per instruction.
+// Row strips are processed in parallel, each with its own ring buffer.
+
+#ifndef TUTORIALS_FUSED_SOBEL_HPP
+#define TUTORIALS_FUSED_SOBEL_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include <vector>
+#include <climits>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// Copies source row y, reflected as BORDER_REFLECT_101, into a row with one
+/// extra pixel on each side.
+inline void sobelPadRow( const cv::Mat& src, int y, uchar* row )
+{
+    const uchar* s = src.ptr<uchar>( cv::borderInterpolate( y, src.rows, cv::BORDER_REFLECT_101 ) );
+    memcpy( row + 1, s, src.cols );
+    row[0] = s[cv::borderInterpolate( -1, src.cols, cv::BORDER_REFLECT_101 )];
+    row[src.cols + 1] = s[cv::borderInterpolate( src.cols, src.cols, cv::BORDER_REFLECT_101 )];
+}
+
+/// Horizontal half of both kernels for one padded row:
+/// D = s(x+1) - s(x-1), S = s(x-1) + 2 s(x) + s(x+1).
+inline void sobelRowTerms( const uchar* row, short* D, short* S, int width )
+{
+    int x = 0;
+#if CV_SSE2
+    __m128i z = _mm_setzero_si128();
+    for( ; x <= width - 8; x += 8 )
+    {
+        __m128i l = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(row + x) ), z );
+        __m128i c = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(row + x + 1) ), z );
+        __m128i r = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(row + x + 2) ), z );
+        _mm_storeu_si128( (__m128i*)(D + x), _mm_sub_epi16( r, l ) );
+        _mm_storeu_si128( (__m128i*)(S + x),
+                _mm_add_epi16( _mm_add_epi16( l, r ), _mm_add_epi16( c, c ) ) );
+    }
+#endif
+    for( ; x < width; x++ )
+    {
+        D[x] = (short)(row[x + 2] - row[x]);
+        S[x] = (short)(row[x] + 2 * row[x + 1] + row[x + 2]);
+    }
+}
+
+/// Ring buffer of the horizontal terms of three consecutive rows.
+/// After next(y), d0/d1/d2 hold D of rows y-1, y, y+1 and s0/s2 hold S of
+/// rows y-1 and y+1, so dx = d0 + 2 d1 + d2 and dy = s2 - s0.
+class SobelRing
+{
+public:
+    SobelRing( const cv::Mat& _src ) : src(_src), row( _src.cols + 2 ), ring( 6 * (size_t)_src.cols )
+    {
+        for( int k = 0; k < 3; k++ )
+        {
+            D[k] = &ring[(2 * k) * (size_t)src.cols];
+            S[k] = &ring[(2 * k + 1) * (size_t)src.cols];
+        }
+        next_row = INT_MIN;
+    }
+
+    void next( int y )
+    {
+        // Fill rows y-1 and y on a jump, only row y+1 when moving down by one
+        int first = next_row == y + 1 ? y + 1 : y - 1;
+        for( int r = first; r <= y + 1; r++ )
+        {
+            int k = (r + 3) % 3;
+            sobelPadRow( src, r, &row[0] );
+            sobelRowTerms( &row[0], D[k], S[k], src.cols );
+        }
+        next_row = y + 2;
+        d0 = D[(y + 2) % 3]; d1 = D[y % 3]; d2 = D[(y + 1) % 3];
+        s0 = S[(y + 2) % 3]; s2 = S[(y + 1) % 3];
+    }
+
+    const short *d0, *d1, *d2, *s0, *s2;
+
+private:
+    const cv::Mat& src;
+    std::vector<uchar> row;
+    std::vector<short> ring;
+    short* D[3];
+    short* S[3];
+    int next_row;
+};
+
+#if CV_SSE2
+/// dx and dy of 8 pixels starting at x.
+inline void sobelDerivs8( const SobelRing& ring, int x, __m128i& gx, __m128i& gy )
+{
+    __m128i m = _mm_loadu_si128( (const __m128i*)(ring.d1 + x) );
+    gx = _mm_add_epi16(
+        _mm_add_epi16( _mm_loadu_si128( (const __m128i*)(ring.d0 + x) ),
+                       _mm_loadu_si128( (const __m128i*)(ring.d2 + x) ) ),
+        _mm_add_epi16( m, m ) );
+    gy = _mm_sub_epi16( _mm_loadu_si128( (const __m128i*)(ring.s2 + x) ),
+                        _mm_loadu_si128( (const __m128i*)(ring.s0 + x) ) );
+}
+#endif
+
+/// Row strips of the fused kernel. Rows in [range.start, range.end) are
+/// written; their halo rows are read again by the neighbouring strips.
+class FusedSobelBody : public cv::ParallelLoopBody
+{
+public:
+    FusedSobelBody( const cv::Mat& _src, cv::Mat& _dst ) : src(_src), dst(_dst) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols;
+        SobelRing ring( src );
+        for( int y = range.start; y < range.end; y++ )
+        {
+            ring.next( y );
+            const short* d0 = ring.d0;
+            const short* d1 = ring.d1;
+            const short* d2 = ring.d2;
+            const short* s0 = ring.s0;
+            const short* s2 = ring.s2;
+            uchar* out = dst.ptr<uchar>(y);
+            int x = 0;
+#if CV_SSE2
+            __m128i z = _mm_setzero_si128(), one = _mm_set1_epi8(1);
+            for( ; x <= width - 16; x += 16 )
+            {
+                __m128i a[2], b[2];
+                for( int h = 0; h < 2; h++ )
+                {
+                    __m128i gx, gy;
+                    sobelDerivs8( ring, x + h * 8, gx, gy );
+                    a[h] = _mm_max_epi16( gx, _mm_sub_epi16( z, gx ) );
+                    b[h] = _mm_max_epi16( gy, _mm_sub_epi16( z, gy ) );
+                }
+                // Saturate like convertScaleAbs, then average like addWeighted,
+                // which rounds halves to even: avg_epu8 rounds them up instead,
+                // so take one back when the sum is odd and the rounded value odd.
+                __m128i ax = _mm_packus_epi16( a[0], a[1] );
+                __m128i ay = _mm_packus_epi16( b[0], b[1] );
+                __m128i avg = _mm_avg_epu8( ax, ay );
+                __m128i fix = _mm_and_si128( _mm_and_si128( _mm_xor_si128( ax, ay ), avg ), one );
+                _mm_storeu_si128( (__m128i*)(out + x), _mm_sub_epi8( avg, fix ) );
+            }
+#endif
+            for( ; x < width; x++ )
+            {
+                int ax = std::min( std::abs( d0[x] + 2 * d1[x] + d2[x] ), 255 );
+                int ay = std::min( std::abs( s2[x] - s0[x] ), 255 );
+                int avg = (ax + ay + 1) >> 1;
+                out[x] = (uchar)(avg - ((ax ^ ay) & avg & 1));
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& dst;
+};
+
+/// Same result as
+///   Sobel( src, gx, CV_16S, 1, 0, 3 ); convertScaleAbs( gx, ax );
+///   Sobel( src, gy, CV_16S, 0, 1, 3 ); convertScaleAbs( gy, ay );
+///   addWeighted( ax, 0.5, ay, 0.5, 0, dst );
+/// in a single read of the 8-bit gray image.
+inline void fusedSobel( const cv::Mat& src, cv::Mat& dst )
+{
+    CV_Assert( src.type() == CV_8UC1 && src.data != dst.data );
+    dst.create( src.rows, src.cols, CV_8UC1 );
+    cv::parallel_for_( cv::Range(0, src.rows), FusedSobelBody( src, dst ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_FUSED_SOBEL_HPP
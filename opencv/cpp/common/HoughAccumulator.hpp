@@ -0,0 +1,305 @@
+// Standard Hough lines, with the accumulator kept so that any threshold is
+// answered without voting again.
+
+// HoughLines( edges, lines, rho, theta, threshold ) does three things:
+//   1. every edge pixel votes for each angle's distance rho, into a
+//      numangle x numrho accumulator
+//   2. cells above the threshold that beat their four neighbours are peaks
+//   3. peaks are sorted by votes (then by position) and turned into lines
+// Only the "above the threshold" part of 2 depends on the threshold. So the
+// accumulator is filled once per edge image, every peak with at least one
+// vote is found and sorted once, and the lines for a threshold are the
+// peaks before the first one with no more votes than it: a binary search.
+
+// Arithmetic and ordering are those of HoughLines (min_theta 0, max_theta
+// pi, no multi-scale), so the lines are the same, in the same order.
+
+// Voting is the expensive part: every edge pixel adds one vote per angle.
+// It is done on all threads:
+//   - the edge pixels are listed, strips of rows in parallel, and the list
+//     is cut into one chunk per thread
+//   - each chunk votes into its own accumulator, so no two threads ever
+//     write the same cell
+//   - the accumulators are added up, rows of angles in parallel
+// A chunk votes angle after angle, not pixel after pixel: the pixels are in
+// raster order, so for one angle their distances move slowly and the cells
+// they hit stay in cache, where one pixel's 180 votes are 180 rows apart.
+// Four pixels go at once in SSE2: distance = x cos + y sin (the tables are
+// divided by rho) rounded as cvRound does, then the four cells are
+// incremented one by one.
+
+#ifndef TUTORIALS_HOUGH_ACCUMULATOR_HPP
+#define TUTORIALS_HOUGH_ACCUMULATOR_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include <algorithm>
+#include <functional>
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// Orders accumulator cells as HoughLines sorts its peaks: more votes
+/// first, then lower index.
+struct HoughPeakGreater
+{
+    HoughPeakGreater( const int* _accum ) : accum(_accum) {}
+    bool operator()( int a, int b ) const
+    { return accum[a] > accum[b] || (accum[a] == accum[b] && a < b); }
+    const int* accum;
+};
+
+/// Votes of count edge points xs[i], ys[i]: for angle n, the cell at
+/// offset[n] plus the rounded x tab_cos[n] + y tab_sin[n].
+inline void houghVotePoints( const float* xs, const float* ys, int count, const float* tab_cos,
+                             const float* tab_sin, const int* offset, int numangle, int* accum )
+{
+    for( int n = 0; n < numangle; n++ )
+    {
+        float c = tab_cos[n], s = tab_sin[n];
+        int* a = accum + offset[n];
+        int i = 0;
+#if CV_SSE2
+        __m128 vc = _mm_set1_ps( c ), vs = _mm_set1_ps( s );
+        for( ; i <= count - 4; i += 4 )
+        {
+            __m128 r = _mm_add_ps( _mm_mul_ps( _mm_loadu_ps( xs + i ), vc ), _mm_mul_ps( _mm_loadu_ps( ys + i ), vs ) );
+            int d[4];
+            _mm_storeu_si128( (__m128i*)d, _mm_cvtps_epi32( r ) );
+            a[d[0]]++;
+            a[d[1]]++;
+            a[d[2]]++;
+            a[d[3]]++;
+        }
+#endif
+        for( ; i < count; i++ ) { a[cvRound( xs[i] * c + ys[i] * s )]++; }
+    }
+}
+
+class HoughEdgePointsBody : public cv::ParallelLoopBody
+{
+public:
+    HoughEdgePointsBody( const cv::Mat& _edges, int _strip_rows, std::vector<int>& _starts,
+                         std::vector<float>& _xs, std::vector<float>& _ys, bool _fill )
+        : edges(_edges), strip_rows(_strip_rows), starts(_starts), xs(_xs), ys(_ys), fill(_fill) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        // Counting: strip s's count into starts[s + 1]; filling: its points
+        // from starts[s] on
+        for( int s = range.start; s < range.end; s++ )
+        {
+            int y1 = std::min( (s + 1) * strip_rows, edges.rows ), k = fill ? starts[s] : 0;
+            for( int y = s * strip_rows; y < y1; y++ )
+            {
+                const uchar* e = edges.ptr<uchar>(y);
+                for( int x = 0; x < edges.cols; x++ )
+                {
+                    if( !e[x] ) { continue; }
+                    if( fill )
+                    {
+                        xs[k] = (float)x;
+                        ys[k] = (float)y;
+                    }
+                    k++;
+                }
+            }
+            if( !fill ) { starts[s + 1] = k; }
+        }
+    }
+
+private:
+    const cv::Mat& edges;
+    int strip_rows;
+    std::vector<int>& starts;
+    std::vector<float>& xs;
+    std::vector<float>& ys;
+    bool fill;
+};
+
+class HoughVoteBody : public cv::ParallelLoopBody
+{
+public:
+    HoughVoteBody( const std::vector<float>& _xs, const std::vector<float>& _ys, const std::vector<float>& _tab_cos,
+                   const std::vector<float>& _tab_sin, const std::vector<int>& _offset, int _chunks,
+                   std::vector<int>& _accum, std::vector<int>& _partial )
+        : xs(_xs), ys(_ys), tab_cos(_tab_cos), tab_sin(_tab_sin), offset(_offset), chunks(_chunks),
+          accum(_accum), partial(_partial) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        // Chunk 0 votes into the accumulator itself, chunk c > 0 into
+        // partial accumulator c - 1
+        size_t cells = accum.size();
+        int count = (int)xs.size();
+        for( int c = range.start; c < range.end; c++ )
+        {
+            int* a = c ? &partial[0] + (c - 1) * cells : &accum[0];
+            std::fill( a, a + cells, 0 );
+            int i0 = (int)((int64)count * c / chunks), i1 = (int)((int64)count * (c + 1) / chunks);
+            if( i1 > i0 )
+            {
+                houghVotePoints( &xs[0] + i0, &ys[0] + i0, i1 - i0, &tab_cos[0], &tab_sin[0], &offset[0],
+                                 (int)offset.size(), a );
+            }
+        }
+    }
+
+private:
+    const std::vector<float>& xs;
+    const std::vector<float>& ys;
+    const std::vector<float>& tab_cos;
+    const std::vector<float>& tab_sin;
+    const std::vector<int>& offset;
+    int chunks;
+    std::vector<int>& accum;
+    std::vector<int>& partial;
+};
+
+class HoughMergeBody : public cv::ParallelLoopBody
+{
+public:
+    HoughMergeBody( std::vector<int>& _accum, const std::vector<int>& _partial, int _parts, int _row )
+        : accum(_accum), partial(_partial), parts(_parts), row(_row) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        size_t cells = accum.size();
+        int* a = &accum[0] + (size_t)range.start * row;
+        int n = (range.end - range.start) * row;
+        for( int p = 0; p < parts; p++ )
+        {
+            const int* b = &partial[0] + p * cells + (size_t)range.start * row;
+            for( int i = 0; i < n; i++ ) { a[i] += b[i]; }
+        }
+    }
+
+private:
+    std::vector<int>& accum;
+    const std::vector<int>& partial;
+    int parts, row;
+};
+
+/// Accumulator and sorted peaks of HoughLines for one edge image: setImage()
+/// votes, then lines() gives HoughLines' result for any threshold >= 0 in
+/// the time it takes to copy it. Votes on all threads, each with an
+/// accumulator of its own ((numangle + 2) (numrho + 2) ints, with numrho
+/// about 2 (width + height)). Keeps its buffers between images.
+class HoughLineAccumulator
+{
+public:
+    HoughLineAccumulator() : numangle(0), numrho(0) {}
+
+    /// Votes for the non zero pixels of a CV_8UC1 edge image, with steps
+    /// rho and theta, and finds the peaks. The edge pixels are split into
+    /// chunks accumulators, 0 for one per thread; 1 votes on one thread.
+    void setImage( const cv::Mat& edges, double rho = 1, double theta = CV_PI / 180, int chunks = 0 )
+    {
+        CV_Assert( edges.type() == CV_8UC1 && rho > 0 && theta > 0 && chunks >= 0 );
+        setGrid( edges.size(), rho, theta );
+
+        // 1. Edge pixels, in raster order
+        int strip_rows = 16, nstrips = (edges.rows + strip_rows - 1) / strip_rows;
+        starts.assign( nstrips + 1, 0 );
+        cv::parallel_for_( cv::Range(0, nstrips), HoughEdgePointsBody( edges, strip_rows, starts, xs, ys, false ) );
+        for( int s = 0; s < nstrips; s++ ) { starts[s + 1] += starts[s]; }
+        xs.resize( starts[nstrips] );
+        ys.resize( starts[nstrips] );
+        cv::parallel_for_( cv::Range(0, nstrips), HoughEdgePointsBody( edges, strip_rows, starts, xs, ys, true ) );
+
+        // 2. Votes, a chunk of pixels per accumulator; no more accumulators
+        //    than there is work for
+        if( chunks == 0 ) { chunks = cv::getNumThreads(); }
+        chunks = std::max( 1, std::min( chunks, (int)xs.size() / 4096 ) );
+        int row = numrho + 2;
+        size_t cells = (size_t)(numangle + 2) * row;
+        accum.resize( cells );
+        partial.resize( (chunks - 1) * cells );
+        cv::parallel_for_( cv::Range(0, chunks),
+                HoughVoteBody( xs, ys, tab_cos, tab_sin, offset, chunks, accum, partial ) );
+
+        // 3. All into the first accumulator
+        if( chunks > 1 )
+        { cv::parallel_for_( cv::Range(0, numangle + 2), HoughMergeBody( accum, partial, chunks - 1, row ) ); }
+        findPeaks();
+    }
+
+    /// The lines HoughLines( edges, lines, rho, theta, threshold ) finds.
+    void lines( int threshold, std::vector<cv::Vec2f>& lines ) const
+    {
+        CV_Assert( threshold >= 0 );
+        int count = (int)(std::lower_bound( peak_votes.begin(), peak_votes.end(), threshold,
+                                            std::greater<int>() ) - peak_votes.begin());
+        lines.assign( peak_lines.begin(), peak_lines.begin() + count );
+    }
+
+    /// Peaks of the image, i.e. lines at threshold 0.
+    int peakCount() const { return (int)peaks.size(); }
+
+private:
+    /// Accumulator size and trigonometric tables (divided by rho), as
+    /// HoughLines makes them; offset[n] is the cell of angle n, distance 0.
+    void setGrid( cv::Size size, double _rho, double _theta )
+    {
+        rho = _rho;
+        theta = _theta;
+        float irho = (float)(1 / rho);
+        numangle = cvFloor( CV_PI / theta ) + 1;
+        if( numangle > 1 && fabs( CV_PI - (numangle - 1) * theta ) < theta / 2 ) { numangle--; }
+        numrho = cvRound( ((size.width + size.height) * 2 + 1) / rho );
+        tab_sin.resize( numangle );
+        tab_cos.resize( numangle );
+        offset.resize( numangle );
+        float ang = 0;
+        for( int n = 0; n < numangle; ang += (float)theta, n++ )
+        {
+            tab_sin[n] = (float)(sin( (double)ang ) * irho);
+            tab_cos[n] = (float)(cos( (double)ang ) * irho);
+            offset[n] = (n + 1) * (numrho + 2) + 1 + (numrho - 1) / 2;
+        }
+    }
+
+    /// Cells with votes, more than the cells before them in rho and theta and
+    /// at least as many as those after, sorted; and their lines.
+    void findPeaks()
+    {
+        const int* a = &accum[0];
+        int step = numrho + 2;
+        peaks.clear();
+        for( int r = 0; r < numrho; r++ )
+        {
+            for( int n = 0; n < numangle; n++ )
+            {
+                int base = (n + 1) * step + r + 1, v = a[base];
+                if( v > 0 && v > a[base - 1] && v >= a[base + 1] && v > a[base - step] && v >= a[base + step] )
+                { peaks.push_back( base ); }
+            }
+        }
+        std::sort( peaks.begin(), peaks.end(), HoughPeakGreater( a ) );
+
+        peak_votes.resize( peaks.size() );
+        peak_lines.resize( peaks.size() );
+        for( size_t i = 0; i < peaks.size(); i++ )
+        {
+            int n = peaks[i] / step - 1, r = peaks[i] - (n + 1) * step - 1;
+            peak_votes[i] = a[peaks[i]];
+            peak_lines[i] = cv::Vec2f( (float)((r - (numrho - 1) * 0.5f) * rho), n * (float)theta );
+        }
+    }
+
+    double rho, theta;
+    int numangle, numrho;
+    std::vector<float> tab_sin, tab_cos;
+    std::vector<int> offset, starts, accum, partial, peaks, peak_votes;
+    std::vector<float> xs, ys;
+    std::vector<cv::Vec2f> peak_lines;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_HOUGH_ACCUMULATOR_HPP
@@ -0,0 +1,380 @@
+// Integral images and an O(1) box filter built on top of them.
+
+// The integral image (summed area table) holds at (y, x) the sum of every
+// source pixel above and to the left of (y, x). With it, the sum over any
+// rectangular window costs four lookups, no matter how large the window is:
+//   sum = I(y1, x1) - I(y0, x1) - I(y1, x0) + I(y0, x0)
+
+// The table is 32 bits wide. A large 8-bit image can overflow it, but the
+// arithmetic is done modulo 2^32, so every window sum that fits in 32 bits
+// (any window up to 16 million pixels) still comes out exact.
+
+// The table is built in two passes, both split across threads:
+//   1. a prefix sum along each row (rows in parallel, SSE2 in-register scan)
+//   2. a running sum down each column (column strips in parallel, SSE2 adds)
+
+// integralSq64 builds the table of squared pixels, for window variances. It
+// is kept in doubles, like the sqsum of cv::integral: squares overflow 32
+// bits after 66 thousand pixels, while doubles hold every sum exactly up to
+// 2^53.
+
+#ifndef TUTORIALS_INTEGRAL_IMAGE_HPP
+#define TUTORIALS_INTEGRAL_IMAGE_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// Largest odd window area for which the float division below is exact
+/// (the rounding error stays under half the gap to the nearest .5).
+static const int BOX_FLOAT_MAX_AREA = 1 << 14;
+
+/// Pass 1: prefix sum along every row, one row per iteration.
+class IntegralRowsBody : public cv::ParallelLoopBody
+{
+public:
+    IntegralRowsBody( const cv::Mat& _src, cv::Mat& _sum ) : src(_src), sum(_sum) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int cn = src.channels();
+        int width = src.cols * cn;
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            unsigned* d = sum.ptr<unsigned>(y + 1);
+            for( int c = 0; c < cn; c++ )
+            { d[c] = 0; }
+            d += cn;
+
+            int x = 0;
+            if( cn == 1 )
+            {
+                unsigned run = 0;
+#if CV_SSE2
+                __m128i z = _mm_setzero_si128();
+                __m128i carry = z;
+                for( ; x <= width - 16; x += 16 )
+                {
+                    __m128i v = _mm_loadu_si128( (const __m128i*)(s + x) );
+                    __m128i lo = _mm_unpacklo_epi8( v, z );
+                    __m128i hi = _mm_unpackhi_epi8( v, z );
+                    // log-step scan inside each group of 8 (max 8*255, fits in 16 bits)
+                    lo = _mm_add_epi16( lo, _mm_slli_si128( lo, 2 ) );
+                    hi = _mm_add_epi16( hi, _mm_slli_si128( hi, 2 ) );
+                    lo = _mm_add_epi16( lo, _mm_slli_si128( lo, 4 ) );
+                    hi = _mm_add_epi16( hi, _mm_slli_si128( hi, 4 ) );
+                    lo = _mm_add_epi16( lo, _mm_slli_si128( lo, 8 ) );
+                    hi = _mm_add_epi16( hi, _mm_slli_si128( hi, 8 ) );
+
+                    __m128i a0 = _mm_add_epi32( _mm_unpacklo_epi16( lo, z ), carry );
+                    __m128i a1 = _mm_add_epi32( _mm_unpackhi_epi16( lo, z ), carry );
+                    carry = _mm_shuffle_epi32( a1, 0xFF );
+                    __m128i a2 = _mm_add_epi32( _mm_unpacklo_epi16( hi, z ), carry );
+                    __m128i a3 = _mm_add_epi32( _mm_unpackhi_epi16( hi, z ), carry );
+                    carry = _mm_shuffle_epi32( a3, 0xFF );
+
+                    _mm_storeu_si128( (__m128i*)(d + x), a0 );
+                    _mm_storeu_si128( (__m128i*)(d + x + 4), a1 );
+                    _mm_storeu_si128( (__m128i*)(d + x + 8), a2 );
+                    _mm_storeu_si128( (__m128i*)(d + x + 12), a3 );
+                }
+                run = (unsigned)_mm_cvtsi128_si32( carry );
+#endif
+                for( ; x < width; x++ )
+                {
+                    run += s[x];
+                    d[x] = run;
+                }
+            }
+            else
+            {
+                // Interleaved channels: cn independent running sums
+                for( int c = 0; c < cn; c++ )
+                { d[c] = s[c]; }
+                for( x = cn; x < width; x++ )
+                { d[x] = d[x - cn] + s[x]; }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& sum;
+};
+
+/// Pass 2: accumulate rows downwards, one strip of columns per iteration.
+class IntegralColsBody : public cv::ParallelLoopBody
+{
+public:
+    IntegralColsBody( cv::Mat& _sum, int _strip ) : sum(_sum), strip(_strip) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = sum.cols * sum.channels();
+        int x0 = range.start * strip;
+        int x1 = std::min( range.end * strip, width );
+        for( int y = 2; y < sum.rows; y++ )
+        {
+            const unsigned* p = sum.ptr<unsigned>(y - 1);
+            unsigned* d = sum.ptr<unsigned>(y);
+            int x = x0;
+#if CV_SSE2
+            for( ; x <= x1 - 4; x += 4 )
+            {
+                __m128i a = _mm_loadu_si128( (const __m128i*)(p + x) );
+                __m128i b = _mm_loadu_si128( (const __m128i*)(d + x) );
+                _mm_storeu_si128( (__m128i*)(d + x), _mm_add_epi32( a, b ) );
+            }
+#endif
+            for( ; x < x1; x++ )
+            { d[x] += p[x]; }
+        }
+    }
+
+private:
+    cv::Mat& sum;
+    int strip;
+};
+
+/// Builds the (rows+1) x (cols+1) CV_32S integral image of an 8-bit image
+/// with any number of channels. Row 0 and column 0 are zero, as in
+/// cv::integral, so a window starting at the image edge needs no special case.
+inline void integral32( const cv::Mat& src, cv::Mat& sum )
+{
+    CV_Assert( src.depth() == CV_8U );
+    int cn = src.channels();
+    sum.create( src.rows + 1, src.cols + 1, CV_32SC(cn) );
+    memset( sum.ptr(0), 0, sum.cols * sum.elemSize() );
+
+    cv::parallel_for_( cv::Range(0, src.rows), IntegralRowsBody( src, sum ) );
+
+    // Enough strips to feed every thread, but wide enough to keep rows streaming
+    int width = sum.cols * cn;
+    int strip = std::max( 64, width / (cv::getNumThreads() * 4) );
+    strip = (strip + 15) & ~15;
+    cv::parallel_for_( cv::Range(0, (width + strip - 1) / strip),
+            IntegralColsBody( sum, strip ) );
+}
+
+/// Pass 1 for squares: prefix sum of squared pixels along every row.
+class IntegralSqRowsBody : public cv::ParallelLoopBody
+{
+public:
+    IntegralSqRowsBody( const cv::Mat& _src, cv::Mat& _sqsum ) : src(_src), sqsum(_sqsum) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            double* d = sqsum.ptr<double>(y + 1);
+            // Integer running sum, so the row adds up exactly
+            uint64 run = 0;
+            d[0] = 0;
+            for( int x = 0; x < src.cols; x++ )
+            {
+                run += (unsigned)(s[x] * s[x]);
+                d[x + 1] = (double)run;
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& sqsum;
+};
+
+/// Pass 2 for squares: accumulate rows downwards, one strip per iteration.
+class IntegralSqColsBody : public cv::ParallelLoopBody
+{
+public:
+    IntegralSqColsBody( cv::Mat& _sqsum, int _strip ) : sqsum(_sqsum), strip(_strip) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int x0 = range.start * strip;
+        int x1 = std::min( range.end * strip, sqsum.cols );
+        for( int y = 2; y < sqsum.rows; y++ )
+        {
+            const double* p = sqsum.ptr<double>(y - 1);
+            double* d = sqsum.ptr<double>(y);
+            int x = x0;
+#if CV_SSE2
+            for( ; x <= x1 - 2; x += 2 )
+            { _mm_storeu_pd( d + x, _mm_add_pd( _mm_loadu_pd( p + x ), _mm_loadu_pd( d + x ) ) ); }
+#endif
+            for( ; x < x1; x++ )
+            { d[x] += p[x]; }
+        }
+    }
+
+private:
+    cv::Mat& sqsum;
+    int strip;
+};
+
+/// Builds the (rows+1) x (cols+1) CV_64F integral image of the squares of a
+/// single channel 8-bit image, laid out like integral32.
+inline void integralSq64( const cv::Mat& src, cv::Mat& sqsum )
+{
+    CV_Assert( src.type() == CV_8UC1 );
+    sqsum.create( src.rows + 1, src.cols + 1, CV_64FC1 );
+    memset( sqsum.ptr(0), 0, sqsum.cols * sqsum.elemSize() );
+
+    cv::parallel_for_( cv::Range(0, src.rows), IntegralSqRowsBody( src, sqsum ) );
+
+    int strip = std::max( 32, sqsum.cols / (cv::getNumThreads() * 4) );
+    strip = (strip + 7) & ~7;
+    cv::parallel_for_( cv::Range(0, (sqsum.cols + strip - 1) / strip),
+            IntegralSqColsBody( sqsum, strip ) );
+}
+
+/// Sum of the w x h window whose top left pixel is (x, y), channel c.
+inline unsigned windowSum( const cv::Mat& sum, int x, int y, int w, int h, int c = 0 )
+{
+    int cn = sum.channels();
+    const unsigned* top = sum.ptr<unsigned>(y);
+    const unsigned* bot = sum.ptr<unsigned>(y + h);
+    int x0 = x * cn + c, x1 = (x + w) * cn + c;
+    return bot[x1] - bot[x0] - top[x1] + top[x0];
+}
+
+/// Turns window sums of the padded image into window means, one output row
+/// per iteration.
+class BoxMeanBody : public cv::ParallelLoopBody
+{
+public:
+    BoxMeanBody( const cv::Mat& _sum, cv::Mat& _dst, cv::Size _ksize )
+        : sum(_sum), dst(_dst), ksize(_ksize) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int cn = dst.channels();
+        int width = dst.cols * cn;
+        int dx = ksize.width * cn;
+        int area = ksize.area();
+        double scale = 1.0 / area;
+        bool useFloat = (area & 1) && area < BOX_FLOAT_MAX_AREA;
+
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const unsigned* top = sum.ptr<unsigned>(y);
+            const unsigned* bot = sum.ptr<unsigned>(y + ksize.height);
+            uchar* d = dst.ptr<uchar>(y);
+            int x = 0;
+#if CV_SSE2
+            if( useFloat )
+            {
+                __m128 inv = _mm_set1_ps( (float)scale );
+                for( ; x <= width - 16; x += 16 )
+                {
+                    __m128i q[4];
+                    for( int k = 0; k < 4; k++ )
+                    {
+                        int i = x + k * 4;
+                        __m128i s = _mm_sub_epi32(
+                            _mm_add_epi32( _mm_loadu_si128( (const __m128i*)(bot + i + dx) ),
+                                           _mm_loadu_si128( (const __m128i*)(top + i) ) ),
+                            _mm_add_epi32( _mm_loadu_si128( (const __m128i*)(bot + i) ),
+                                           _mm_loadu_si128( (const __m128i*)(top + i + dx) ) ) );
+                        // Odd areas never land on .5, so round-to-nearest is exact
+                        q[k] = _mm_cvtps_epi32( _mm_mul_ps( _mm_cvtepi32_ps( s ), inv ) );
+                    }
+                    __m128i w0 = _mm_packs_epi32( q[0], q[1] );
+                    __m128i w1 = _mm_packs_epi32( q[2], q[3] );
+                    _mm_storeu_si128( (__m128i*)(d + x), _mm_packus_epi16( w0, w1 ) );
+                }
+            }
+#endif
+            for( ; x < width; x++ )
+            {
+                unsigned s = bot[x + dx] - bot[x] - top[x + dx] + top[x];
+                d[x] = cv::saturate_cast<uchar>( s * scale );
+            }
+        }
+    }
+
+private:
+    const cv::Mat& sum;
+    cv::Mat& dst;
+    cv::Size ksize;
+};
+
+/// Normalized box filter whose cost does not depend on the kernel size.
+/// Produces the same output as cv::blur for 8-bit images. The padded copy
+/// and the integral image grow with src + ksize - 1, so they live in
+/// buffers that only grow and are used through ROIs: after reserve() for
+/// the largest kernel, a kernel sweep over images of that size allocates
+/// nothing more.
+class BoxFilter
+{
+public:
+    /// Makes room for images of src_size and type with kernels up to
+    /// max_ksize.
+    void reserve( cv::Size src_size, int type, cv::Size max_ksize )
+    {
+        roi( padded_buf, src_size.height + max_ksize.height - 1, src_size.width + max_ksize.width - 1, type );
+        roi( sum_buf, src_size.height + max_ksize.height, src_size.width + max_ksize.width,
+             CV_32SC(CV_MAT_CN(type)) );
+    }
+
+    void apply( const cv::Mat& src, cv::Mat& dst, cv::Size ksize,
+                cv::Point anchor = cv::Point(-1, -1),
+                int borderType = cv::BORDER_DEFAULT )
+    {
+        CV_Assert( src.depth() == CV_8U && ksize.width > 0 && ksize.height > 0 );
+        if( anchor.x < 0 ) { anchor.x = ksize.width / 2; }
+        if( anchor.y < 0 ) { anchor.y = ksize.height / 2; }
+
+        // Exactly sized views, so copyMakeBorder and integral32 find their
+        // outputs already allocated
+        int rows = src.rows + ksize.height - 1, cols = src.cols + ksize.width - 1;
+        padded = roi( padded_buf, rows, cols, src.type() );
+        sum = roi( sum_buf, rows + 1, cols + 1, CV_32SC(src.channels()) );
+        cv::copyMakeBorder( src, padded, anchor.y, ksize.height - 1 - anchor.y,
+                anchor.x, ksize.width - 1 - anchor.x, borderType & ~cv::BORDER_ISOLATED );
+        integral32( padded, sum );
+
+        dst.create( src.rows, src.cols, src.type() );
+        cv::parallel_for_( cv::Range(0, src.rows), BoxMeanBody( sum, dst, ksize ) );
+    }
+
+    /// Integral image of the padded source from the last call.
+    const cv::Mat& integral() const { return sum; }
+
+private:
+    /// Top left rows x cols of buf, buf grown first if too small.
+    static cv::Mat roi( cv::Mat& buf, int rows, int cols, int type )
+    {
+        if( buf.type() != type || buf.rows < rows || buf.cols < cols )
+        {
+            bool same = buf.type() == type;
+            buf.create( std::max( rows, same ? buf.rows : 0 ), std::max( cols, same ? buf.cols : 0 ), type );
+        }
+        return buf( cv::Rect( 0, 0, cols, rows ) );
+    }
+
+    cv::Mat padded_buf, sum_buf;
+    cv::Mat padded;
+    cv::Mat sum;
+};
+
+/// One-shot version of BoxFilter::apply, same arguments as cv::blur.
+inline void boxBlur( const cv::Mat& src, cv::Mat& dst, cv::Size ksize,
+                     cv::Point anchor = cv::Point(-1, -1),
+                     int borderType = cv::BORDER_DEFAULT )
+{
+    BoxFilter box;
+    box.apply( src, dst, ksize, anchor, borderType );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_INTEGRAL_IMAGE_HPP
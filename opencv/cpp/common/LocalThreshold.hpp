@@ -0,0 +1,141 @@
+// Local (adaptive) thresholds from integral images.
+
+// A global threshold fails on unevenly lit images: the background on the
+// dark side is darker than the foreground on the bright side. Local methods
+// compare every pixel with statistics of the block around it instead:
+//   Bradley  T = m (1 - k)                    m: block mean
+//   Sauvola  T = m (1 + k (s / R - 1))        s: block standard deviation,
+//                                             R = 128, half the 8-bit range
+// and set the pixel to maxval when it is above T, 0 otherwise.
+
+// The block mean and variance come from integral images of the pixels and
+// of their squares, four lookups each, so the cost per pixel is the same
+// for a 15 x 15 block as for a 255 x 255 one. Blocks are clipped at the
+// image edges and their statistics taken over the pixels inside.
+
+#ifndef TUTORIALS_LOCAL_THRESHOLD_HPP
+#define TUTORIALS_LOCAL_THRESHOLD_HPP
+
+#include "IntegralImage.hpp"
+#include <math.h>
+
+namespace tut
+{
+
+enum LocalThresholdMethod
+{
+    LOCAL_THRESH_BRADLEY = 0,
+    LOCAL_THRESH_SAUVOLA = 1
+};
+
+class LocalThresholdBody : public cv::ParallelLoopBody
+{
+public:
+    LocalThresholdBody( const cv::Mat& _src, const cv::Mat& _sum, const cv::Mat& _sqsum, cv::Mat& _dst,
+                        int _method, int _radius, double _k, uchar _maxval )
+        : src(_src), sum(_sum), sqsum(_sqsum), dst(_dst), method(_method),
+          radius(_radius), k(_k), maxval(_maxval) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols;
+        // Clipped block columns, the same for every row
+        std::vector<int> xs0( width ), xs1( width );
+        for( int x = 0; x < width; x++ )
+        {
+            xs0[x] = std::max( x - radius, 0 );
+            xs1[x] = std::min( x + radius + 1, width );
+        }
+        const double inv_r = 1. / 128;
+
+        for( int y = range.start; y < range.end; y++ )
+        {
+            int y0 = std::max( y - radius, 0 ), y1 = std::min( y + radius + 1, src.rows );
+            const unsigned* top = sum.ptr<unsigned>(y0);
+            const unsigned* bot = sum.ptr<unsigned>(y1);
+            const uchar* s = src.ptr<uchar>(y);
+            uchar* d = dst.ptr<uchar>(y);
+
+            if( method == LOCAL_THRESH_BRADLEY )
+            {
+                // s > m (1 - k)  <=>  s * n > S (1 - k), no division per pixel
+                double scale = 1. - k;
+                for( int x = 0; x < width; x++ )
+                {
+                    int x0 = xs0[x], x1 = xs1[x];
+                    unsigned S = bot[x1] - bot[x0] - top[x1] + top[x0];
+                    int n = (y1 - y0) * (x1 - x0);
+                    d[x] = (double)s[x] * n > S * scale ? maxval : 0;
+                }
+            }
+            else
+            {
+                const double* qtop = sqsum.ptr<double>(y0);
+                const double* qbot = sqsum.ptr<double>(y1);
+                for( int x = 0; x < width; x++ )
+                {
+                    int x0 = xs0[x], x1 = xs1[x];
+                    double S = (double)(bot[x1] - bot[x0] - top[x1] + top[x0]);
+                    double Q = qbot[x1] - qbot[x0] - qtop[x1] + qtop[x0];
+                    double inv_n = 1. / ((y1 - y0) * (x1 - x0));
+                    double m = S * inv_n;
+                    double var = std::max( (Q - S * m) * inv_n, 0. );
+                    double t = m * (1. + k * (sqrt( var ) * inv_r - 1.));
+                    d[x] = s[x] > t ? maxval : 0;
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    const cv::Mat& sum;
+    const cv::Mat& sqsum;
+    cv::Mat& dst;
+    int method;
+    int radius;
+    double k;
+    uchar maxval;
+};
+
+/// Bradley or Sauvola threshold of an 8-bit gray image over blockSize x
+/// blockSize blocks (blockSize odd). Typical k: 0.15 for Bradley, 0.2 to 0.5
+/// for Sauvola. Keeps its integral images between calls, so sweeping the
+/// parameters over one image allocates only once.
+class LocalThreshold
+{
+public:
+    void apply( const cv::Mat& src, cv::Mat& dst, int method, int blockSize, double k,
+                int maxval = 255 )
+    {
+        CV_Assert( src.type() == CV_8UC1 && blockSize % 2 == 1 && blockSize > 1 );
+        CV_Assert( method == LOCAL_THRESH_BRADLEY || method == LOCAL_THRESH_SAUVOLA );
+        CV_Assert( src.data != dst.data );
+
+        integral32( src, sum );
+        if( method == LOCAL_THRESH_SAUVOLA )
+        { integralSq64( src, sqsum ); }
+
+        dst.create( src.rows, src.cols, CV_8UC1 );
+        cv::parallel_for_( cv::Range(0, src.rows),
+                LocalThresholdBody( src, sum, sqsum, dst, method, blockSize / 2, k,
+                                    cv::saturate_cast<uchar>( maxval ) ),
+                std::max( 1, src.rows / 32 ) );
+    }
+
+private:
+    cv::Mat sum;
+    cv::Mat sqsum;
+};
+
+/// One-shot version of LocalThreshold::apply.
+inline void localThreshold( const cv::Mat& src, cv::Mat& dst, int method, int blockSize, double k,
+                            int maxval = 255 )
+{
+    LocalThreshold local;
+    local.apply( src, dst, method, blockSize, k, maxval );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_LOCAL_THRESHOLD_HPP
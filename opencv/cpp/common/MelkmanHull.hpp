@@ -0,0 +1,261 @@
+// Convex hulls of contours in one walk along each (Melkman's algorithm).
+
+// convexHull accepts any point set, so it sorts the points first:
+// O(n log n) per contour. A contour from findContours is not any point set
+// but a closed polyline, and for a polyline that does not cross itself
+// Melkman's algorithm builds the hull in one walk along the points. The hull
+// is kept in a deque whose two ends are both the last point added:
+//   - a point left of both end edges (or on one) is inside the hull so
+//     far: skipped
+//   - otherwise it is pushed on both ends, after popping from each end the
+//     points it makes concave
+// Every point is pushed and popped at most twice, so the cost is O(n).
+
+// Traced contours may touch themselves, though: a one pixel wide spur is
+// walked out and back, and the walk can then leave the hull somewhere else
+// than at the deque ends, which Melkman does not expect. So every result is
+// checked: strictly convex, and each point inside, found among the hull's
+// fan of triangles by bisection, O(n log h) for h hull points. The few
+// contours that fail get a sorted monotone chain hull instead.
+
+// The work is done on point indices, in one buffer with room for 2n + 1 of
+// them per contour, so contours are handled in parallel without allocating;
+// the hulls are then copied together into an arena.
+
+#ifndef TUTORIALS_MELKMAN_HULL_HPP
+#define TUTORIALS_MELKMAN_HULL_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "ContourArena.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace tut
+{
+
+/// > 0 when c is left of a -> b (counter-clockwise, with y up), 0 when the
+/// three are collinear.
+inline int64 hullCross( cv::Point a, cv::Point b, cv::Point c )
+{ return (int64)(b.x - a.x) * (c.y - a.y) - (int64)(b.y - a.y) * (c.x - a.x); }
+
+/// Melkman on the polyline pts[0..n-1], n > 0, with the deque in buf[0..2n].
+/// Returns the hull as indices buf[*first..*first + count - 1], counter-
+/// clockwise with y up, without collinear points.
+inline int melkmanIndices( const cv::Point* pts, int n, int* buf, int* first )
+{
+    // Extremes of the leading collinear run, then the first point off it
+    int a = 0, b = 1, k;
+    while( b < n && pts[b] == pts[a] ) { b++; }
+    *first = 0;
+    if( b == n )
+    {
+        buf[0] = 0;
+        return 1;
+    }
+    for( k = b + 1; k < n; k++ )
+    {
+        cv::Point p = pts[k], pa = pts[a], pb = pts[b];
+        if( hullCross( pa, pb, p ) != 0 ) { break; }
+        // On the line: extend the run if p lies outside a..b
+        if( (int64)(p.x - pa.x) * (pb.x - pa.x) + (int64)(p.y - pa.y) * (pb.y - pa.y) < 0 ) { a = k; }
+        else if( (int64)(p.x - pb.x) * (pa.x - pb.x) + (int64)(p.y - pb.y) * (pa.y - pb.y) < 0 ) { b = k; }
+    }
+    if( k == n )
+    {
+        buf[0] = a;
+        buf[1] = b;
+        return 2;
+    }
+
+    // buf[bot..top], buf[bot] == buf[top] == the last point added
+    int bot = n, top = n + 3;
+    bool left = hullCross( pts[a], pts[b], pts[k] ) > 0;
+    buf[bot] = buf[top] = k;
+    buf[bot + 1] = left ? a : b;
+    buf[bot + 2] = left ? b : a;
+
+    for( k++; k < n; k++ )
+    {
+        cv::Point p = pts[k];
+        // Inside, or on an end edge (collinear points are not kept)
+        if( hullCross( pts[buf[bot]], pts[buf[bot + 1]], p ) >= 0 &&
+            hullCross( pts[buf[top - 1]], pts[buf[top]], p ) >= 0 )
+        { continue; }
+
+        while( top - bot > 1 && hullCross( pts[buf[top - 1]], pts[buf[top]], p ) <= 0 ) { top--; }
+        buf[++top] = k;
+        while( top - bot > 1 && hullCross( p, pts[buf[bot]], pts[buf[bot + 1]] ) <= 0 ) { bot++; }
+        buf[--bot] = k;
+    }
+
+    *first = bot;
+    return top - bot;
+}
+
+/// Whether hull[0..m-1], m >= 3 indices counter-clockwise, is the strictly
+/// convex hull of pts[0..n-1]: convex, and every point inside it. A point
+/// is found in the fan of triangles around hull[0] by bisection.
+inline bool checkContourHull( const cv::Point* pts, int n, const int* hull, int m )
+{
+    for( int j = 0; j < m; j++ )
+    {
+        if( hullCross( pts[hull[j]], pts[hull[(j + 1) % m]], pts[hull[(j + 2) % m]] ) <= 0 )
+        { return false; }
+    }
+    cv::Point h0 = pts[hull[0]];
+    for( int i = 0; i < n; i++ )
+    {
+        cv::Point p = pts[i];
+        if( hullCross( h0, pts[hull[1]], p ) < 0 || hullCross( h0, pts[hull[m - 1]], p ) > 0 )
+        { return false; }
+        // Last j in 1..m-2 with p left of h0 -> hull[j]
+        int lo = 1, hi = m - 2;
+        while( lo < hi )
+        {
+            int mid = (lo + hi + 1) >> 1;
+            if( hullCross( h0, pts[hull[mid]], p ) >= 0 ) { lo = mid; }
+            else { hi = mid - 1; }
+        }
+        if( hullCross( pts[hull[lo]], pts[hull[lo + 1]], p ) < 0 ) { return false; }
+    }
+    return true;
+}
+
+struct HullIndexLess
+{
+    HullIndexLess( const cv::Point* _pts ) : pts(_pts) {}
+    bool operator()( int a, int b ) const
+    { return pts[a].x < pts[b].x || (pts[a].x == pts[b].x && pts[a].y < pts[b].y); }
+    const cv::Point* pts;
+};
+
+/// Monotone chain on sorted indices, in buf[0..2n] as melkmanIndices: the
+/// O(n log n) hull for the contours Melkman cannot take.
+inline int monotoneChainIndices( const cv::Point* pts, int n, int* buf, int* first )
+{
+    int* idx = buf;
+    int* h = buf + n;
+    for( int i = 0; i < n; i++ ) { idx[i] = i; }
+    std::sort( idx, idx + n, HullIndexLess( pts ) );
+
+    // Lower chain left to right, then upper chain back
+    int k = 0;
+    for( int i = 0; i < n; i++ )
+    {
+        while( k >= 2 && hullCross( pts[h[k - 2]], pts[h[k - 1]], pts[idx[i]] ) <= 0 ) { k--; }
+        h[k++] = idx[i];
+    }
+    for( int i = n - 2, lower = k + 1; i >= 0; i-- )
+    {
+        while( k >= lower && hullCross( pts[h[k - 2]], pts[h[k - 1]], pts[idx[i]] ) <= 0 ) { k--; }
+        h[k++] = idx[i];
+    }
+    *first = n;
+    // The last point closes the chain on the first
+    return std::max( k - 1, 1 );
+}
+
+/// Hull of a closed contour as indices into pts, counter-clockwise with y
+/// up; *sorted tells when the monotone chain had to be used.
+inline int contourHullIndices( const cv::Point* pts, int n, int* buf, int* first, bool* sorted )
+{
+    *sorted = false;
+    *first = 0;
+    if( n == 0 ) { return 0; }
+    int m = melkmanIndices( pts, n, buf, first );
+    if( m < 3 || checkContourHull( pts, n, buf + *first, m ) ) { return m; }
+    *sorted = true;
+    return monotoneChainIndices( pts, n, buf, first );
+}
+
+class MelkmanHullBody : public cv::ParallelLoopBody
+{
+public:
+    MelkmanHullBody( const ContourArena& _contours, std::vector<int>& _buf,
+                     std::vector<int>& _first, std::vector<int>& _count, std::vector<uchar>& _sorted )
+        : contours(_contours), buf(_buf), first(_first), count(_count), sorted(_sorted) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int i = range.start; i < range.end; i++ )
+        {
+            // Contour i's space starts at 2 offsets[i] + i
+            int base = 2 * contours.offsets[i] + i, f;
+            bool s;
+            count[i] = contourHullIndices( contours.begin( i ), contours.length( i ), &buf[0] + base, &f, &s );
+            first[i] = base + f;
+            sorted[i] = s;
+        }
+    }
+
+private:
+    const ContourArena& contours;
+    std::vector<int>& buf;
+    std::vector<int>& first;
+    std::vector<int>& count;
+    std::vector<uchar>& sorted;
+};
+
+class GatherHullsBody : public cv::ParallelLoopBody
+{
+public:
+    GatherHullsBody( const ContourArena& _contours, const std::vector<int>& _buf,
+                     const std::vector<int>& _first, bool _clockwise, ContourArena& _hulls )
+        : contours(_contours), buf(_buf), first(_first), clockwise(_clockwise), hulls(_hulls) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int i = range.start; i < range.end; i++ )
+        {
+            int n = hulls.length( i );
+            const int* s = &buf[0] + first[i];
+            const cv::Point* pts = contours.begin( i );
+            cv::Point* d = &hulls.points[0] + hulls.offsets[i];
+            for( int j = 0; j < n; j++ ) { d[j] = pts[s[clockwise ? n - 1 - j : j]]; }
+        }
+    }
+
+private:
+    const ContourArena& contours;
+    const std::vector<int>& buf;
+    const std::vector<int>& first;
+    bool clockwise;
+    ContourArena& hulls;
+};
+
+/// Hull i of every contour i of an arena, into another arena: the points
+/// convexHull( contour, hull, clockwise ) gives, possibly starting from
+/// another one. Keeps its buffers between calls.
+class MelkmanHulls
+{
+public:
+    void compute( const ContourArena& contours, ContourArena& hulls, bool clockwise = false )
+    {
+        int n = contours.size();
+        hulls.clear();
+        buf.resize( 2 * (size_t)contours.total() + n );
+        first.resize( n );
+        count.resize( n );
+        sorted.resize( n );
+        cv::parallel_for_( cv::Range(0, n), MelkmanHullBody( contours, buf, first, count, sorted ),
+                std::max( 1, n / 64 ) );
+
+        hulls.offsets.resize( n + 1 );
+        for( int i = 0; i < n; i++ ) { hulls.offsets[i + 1] = hulls.offsets[i] + count[i]; }
+        hulls.points.resize( hulls.offsets[n] );
+        cv::parallel_for_( cv::Range(0, n), GatherHullsBody( contours, buf, first, clockwise, hulls ),
+                std::max( 1, n / 64 ) );
+    }
+
+    /// Contours of the last call that needed the sorted hull.
+    int sortedCount() const { return (int)std::count( sorted.begin(), sorted.end(), 1 ); }
+
+private:
+    std::vector<int> buf, first, count;
+    std::vector<uchar> sorted;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_MELKMAN_HULL_HPP
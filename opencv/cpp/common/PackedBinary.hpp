@@ -0,0 +1,488 @@
+// Binary images with one bit per pixel.
+
+// A THRESH_BINARY result only holds one bit of information per pixel, but is
+// stored as a byte of 0 or 255. PackedBinary keeps 64 pixels per word
+// instead, the leftmost pixel in the lowest bit, so the image is 8 times
+// smaller and logic and morphology work on 64 pixels per instruction:
+//   - packThreshold compares 16 pixels per SSE2 instruction and gathers the
+//     results into bits with movemask, without writing the byte image
+//   - bitwise ops and rectangular erode / dilate are word operations, a
+//     horizontal neighbour being a shift carrying one bit from the next word
+//   - findPackedContours traces borders reading the packed rows directly and
+//     finds where borders start a word at a time
+
+// The bits past the last column of each row are kept at zero, so whole words
+// can be compared and counted.
+
+#ifndef TUTORIALS_PACKED_BINARY_HPP
+#define TUTORIALS_PACKED_BINARY_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "ContourArena.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// Index of the lowest set bit of a non zero word.
+inline int lowestBit( uint64 w )
+{
+#if defined __GNUC__
+    return __builtin_ctzll( w );
+#else
+    int b = 0;
+    while( !(w & 1) ) { w >>= 1; b++; }
+    return b;
+#endif
+}
+
+inline int popCount64( uint64 w )
+{
+#if defined __GNUC__
+    return __builtin_popcountll( w );
+#else
+    w = w - ((w >> 1) & 0x5555555555555555ULL);
+    w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+    w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+class PackedBinary
+{
+public:
+    PackedBinary() : rows(0), cols(0), step(0) {}
+    PackedBinary( int _rows, int _cols ) { create( _rows, _cols ); }
+
+    /// Allocates a cleared image (all pixels 0).
+    void create( int _rows, int _cols )
+    {
+        rows = _rows;
+        cols = _cols;
+        step = (_cols + 63) / 64;
+        bits.assign( (size_t)rows * step, 0 );
+    }
+
+    bool empty() const { return bits.empty(); }
+    cv::Size size() const { return cv::Size( cols, rows ); }
+    size_t bytes() const { return bits.size() * sizeof(uint64); }
+
+    uint64* row( int y ) { return &bits[(size_t)y * step]; }
+    const uint64* row( int y ) const { return &bits[(size_t)y * step]; }
+
+    /// Pixel value, 0 outside the image.
+    bool at( int x, int y ) const
+    {
+        return (unsigned)x < (unsigned)cols && (unsigned)y < (unsigned)rows &&
+               ((row(y)[x >> 6] >> (x & 63)) & 1) != 0;
+    }
+    void set( int x, int y ) { row(y)[x >> 6] |= (uint64)1 << (x & 63); }
+
+    /// The bits of the last word of a row that are inside the image.
+    uint64 lastMask() const
+    { return (cols & 63) ? ~(uint64)0 >> (64 - (cols & 63)) : ~(uint64)0; }
+
+    int rows, cols;
+    int step;                   // words per row
+    std::vector<uint64> bits;
+};
+
+class PackThresholdBody : public cv::ParallelLoopBody
+{
+public:
+    PackThresholdBody( const cv::Mat& _src, PackedBinary& _dst, int _thresh )
+        : src(_src), dst(_dst), thresh(_thresh) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            uint64* d = dst.row(y);
+            int x = 0;
+#if CV_SSE2
+            // Unsigned compare as signed after flipping the top bit
+            __m128i bias = _mm_set1_epi8( (char)0x80 );
+            __m128i t = _mm_set1_epi8( (char)(thresh ^ 0x80) );
+            for( ; x <= src.cols - 64; x += 64 )
+            {
+                uint64 w = 0;
+                for( int k = 0; k < 4; k++ )
+                {
+                    __m128i v = _mm_xor_si128( _mm_loadu_si128( (const __m128i*)(s + x + 16 * k) ), bias );
+                    w |= (uint64)(unsigned)_mm_movemask_epi8( _mm_cmpgt_epi8( v, t ) ) << (16 * k);
+                }
+                d[x >> 6] = w;
+            }
+#endif
+            for( ; x < src.cols; x += 64 )
+            {
+                uint64 w = 0;
+                int n = std::min( 64, src.cols - x );
+                for( int b = 0; b < n; b++ )
+                { w |= (uint64)(s[x + b] > thresh) << b; }
+                d[x >> 6] = w;
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    PackedBinary& dst;
+    int thresh;
+};
+
+/// Packed threshold( src, dst, thresh, 255, THRESH_BINARY ): bit set where
+/// src > thresh. thresh = 0 packs any binary 8-bit image.
+inline void packThreshold( const cv::Mat& src, PackedBinary& dst, int thresh = 0 )
+{
+    CV_Assert( src.type() == CV_8UC1 );
+    dst.create( src.rows, src.cols );
+    if( dst.empty() || thresh >= 255 ) { return; }
+    thresh = std::max( thresh, -1 );
+    if( thresh < 0 )
+    {
+        // Everything is above: no compare, just the valid bits
+        for( int y = 0; y < dst.rows; y++ )
+        {
+            uint64* d = dst.row(y);
+            for( int w = 0; w < dst.step; w++ ) { d[w] = ~(uint64)0; }
+            d[dst.step - 1] = dst.lastMask();
+        }
+        return;
+    }
+    cv::parallel_for_( cv::Range(0, src.rows), PackThresholdBody( src, dst, thresh ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+/// Expands to 8 bits per pixel: set bits become `value`, the others 0.
+inline void unpackBinary( const PackedBinary& src, cv::Mat& dst, uchar value = 255 )
+{
+    // 8 pixels at a time: one table entry per byte of bits
+    uint64 spread[256];
+    for( int i = 0; i < 256; i++ )
+    {
+        uint64 e = 0;
+        for( int b = 0; b < 8; b++ )
+        {
+            if( i & (1 << b) ) { e |= (uint64)value << (8 * b); }
+        }
+        spread[i] = e;
+    }
+
+    dst.create( src.rows, src.cols, CV_8UC1 );
+    for( int y = 0; y < src.rows; y++ )
+    {
+        const uint64* s = src.row(y);
+        uchar* d = dst.ptr<uchar>(y);
+        int x = 0;
+        for( ; x <= src.cols - 8; x += 8 )
+        {
+            uint64 e = spread[(s[x >> 6] >> (x & 63)) & 255];
+            memcpy( d + x, &e, 8 );
+        }
+        for( ; x < src.cols; x++ )
+        { d[x] = src.at( x, y ) ? value : 0; }
+    }
+}
+
+/// Number of set pixels.
+inline size_t countPacked( const PackedBinary& src )
+{
+    size_t n = 0;
+    for( size_t i = 0; i < src.bits.size(); i++ ) { n += popCount64( src.bits[i] ); }
+    return n;
+}
+
+enum PackedLogicOp { PACKED_AND, PACKED_OR, PACKED_XOR, PACKED_AND_NOT };
+
+/// dst = a op b, word by word; PACKED_AND_NOT is a & ~b.
+inline void bitwisePacked( const PackedBinary& a, const PackedBinary& b, PackedBinary& dst, int op )
+{
+    CV_Assert( a.rows == b.rows && a.cols == b.cols );
+    if( &dst != &a && &dst != &b ) { dst.create( a.rows, a.cols ); }
+    size_t n = a.bits.size();
+    const uint64* pa = a.bits.empty() ? 0 : &a.bits[0];
+    const uint64* pb = b.bits.empty() ? 0 : &b.bits[0];
+    uint64* pd = dst.bits.empty() ? 0 : &dst.bits[0];
+    switch( op )
+    {
+    case PACKED_AND:     for( size_t i = 0; i < n; i++ ) { pd[i] = pa[i] & pb[i]; } break;
+    case PACKED_OR:      for( size_t i = 0; i < n; i++ ) { pd[i] = pa[i] | pb[i]; } break;
+    case PACKED_XOR:     for( size_t i = 0; i < n; i++ ) { pd[i] = pa[i] ^ pb[i]; } break;
+    case PACKED_AND_NOT: for( size_t i = 0; i < n; i++ ) { pd[i] = pa[i] & ~pb[i]; } break;
+    default: CV_Assert( op >= PACKED_AND && op <= PACKED_AND_NOT );
+    }
+}
+
+/// dst = ~src, padding bits kept at zero.
+inline void bitwiseNotPacked( const PackedBinary& src, PackedBinary& dst )
+{
+    if( &dst != &src ) { dst.create( src.rows, src.cols ); }
+    uint64 last = src.lastMask();
+    for( int y = 0; y < src.rows; y++ )
+    {
+        const uint64* s = src.row(y);
+        uint64* d = dst.row(y);
+        for( int w = 0; w < src.step; w++ ) { d[w] = ~s[w]; }
+        d[src.step - 1] &= last;
+    }
+}
+
+class PackedMorphBody : public cv::ParallelLoopBody
+{
+public:
+    PackedMorphBody( const PackedBinary& _src, PackedBinary& _dst, bool _dilate, cv::Size _ksize )
+        : src(_src), dst(_dst), dilate(_dilate), ksize(_ksize) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int rx = ksize.width / 2, ry = ksize.height / 2, n = src.step;
+        uint64 last = src.lastMask();
+        // Outside the image counts as 0 for dilate and 1 for erode, so the
+        // border never changes the result (as with erode / dilate defaults)
+        uint64 fill = dilate ? 0 : ~(uint64)0;
+        std::vector<uint64> line( n + 2 ), h( n ), acc( n );
+
+        for( int y = range.start; y < range.end; y++ )
+        {
+            for( int w = 0; w < n; w++ ) { acc[w] = fill; }
+            for( int yy = y - ry; yy <= y + ry; yy++ )
+            {
+                // Row yy with a fill word on either side and fill past the last column
+                line[0] = line[n + 1] = fill;
+                if( (unsigned)yy < (unsigned)src.rows )
+                {
+                    memcpy( &line[1], src.row(yy), n * sizeof(uint64) );
+                    line[n] |= fill & ~last;
+                }
+                else
+                {
+                    for( int w = 1; w <= n; w++ ) { line[w] = fill; }
+                }
+
+                // Horizontal: combine the shifts by 1..rx both ways
+                for( int w = 0; w < n; w++ )
+                {
+                    uint64 c = line[w + 1], l = line[w], r = line[w + 2], v = c;
+                    for( int s = 1; s <= rx; s++ )
+                    {
+                        uint64 left = (c << s) | (l >> (64 - s));
+                        uint64 right = (c >> s) | (r << (64 - s));
+                        v = dilate ? (v | left | right) : (v & left & right);
+                    }
+                    h[w] = v;
+                }
+                // Vertical: combine the rows
+                for( int w = 0; w < n; w++ )
+                { acc[w] = dilate ? (acc[w] | h[w]) : (acc[w] & h[w]); }
+            }
+            uint64* d = dst.row(y);
+            for( int w = 0; w < n; w++ ) { d[w] = acc[w]; }
+            d[n - 1] &= last;
+        }
+    }
+
+private:
+    const PackedBinary& src;
+    PackedBinary& dst;
+    bool dilate;
+    cv::Size ksize;
+};
+
+/// Rectangular erode or dilate with a centered anchor; ksize is odd, and at
+/// most 127 wide.
+inline void morphPacked( const PackedBinary& src, PackedBinary& dst, bool dilate, cv::Size ksize )
+{
+    CV_Assert( ksize.width % 2 == 1 && ksize.height % 2 == 1 && ksize.width <= 127 );
+    CV_Assert( &src != &dst );
+    dst.create( src.rows, src.cols );
+    if( src.empty() ) { return; }
+    cv::parallel_for_( cv::Range(0, src.rows), PackedMorphBody( src, dst, dilate, ksize ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+inline void erodePacked( const PackedBinary& src, PackedBinary& dst, cv::Size ksize = cv::Size(3, 3) )
+{ morphPacked( src, dst, false, ksize ); }
+
+inline void dilatePacked( const PackedBinary& src, PackedBinary& dst, cv::Size ksize = cv::Size(3, 3) )
+{ morphPacked( src, dst, true, ksize ); }
+
+/// Neighbour offsets by chain code, counterclockwise from the right.
+static const int chainDx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+static const int chainDy[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+
+/// Follows one border from (x0, y0), the first pixel of an outer border or
+/// the last pixel before a hole, as findContours does (Suzuki-Abe). A border
+/// pixel is marked visited, and also `right` when its right neighbour is 0
+/// and was looked at; these two marks are all the scan needs.
+inline void tracePackedBorder( const PackedBinary& img, PackedBinary& visited, PackedBinary& right,
+                               int x0, int y0, bool hole, bool simple,
+                               std::vector<cv::Point>& contour )
+{
+    contour.clear();
+    int s = hole ? 0 : 4, s_end = s;
+    do { s = (s - 1) & 7; }
+    while( !img.at( x0 + chainDx[s], y0 + chainDy[s] ) && s != s_end );
+
+    if( s == s_end )
+    {
+        // Isolated pixel
+        visited.set( x0, y0 );
+        right.set( x0, y0 );
+        contour.push_back( cv::Point( x0, y0 ) );
+        return;
+    }
+
+    int x1 = x0 + chainDx[s], y1 = y0 + chainDy[s];
+    int x3 = x0, y3 = y0, prev_s = s ^ 4;
+    for( ;; )
+    {
+        // Counterclockwise from the pixel we came from to the next border pixel
+        s_end = s;
+        int x4, y4;
+        do
+        {
+            s++;
+            x4 = x3 + chainDx[s & 7];
+            y4 = y3 + chainDy[s & 7];
+        }
+        while( !img.at( x4, y4 ) );
+        s &= 7;
+
+        // The right neighbour was passed (and is 0) when the search wrapped
+        if( (unsigned)(s - 1) < (unsigned)s_end ) { right.set( x3, y3 ); }
+        visited.set( x3, y3 );
+
+        if( !simple || s != prev_s )
+        {
+            contour.push_back( cv::Point( x3, y3 ) );
+            prev_s = s;
+        }
+
+        if( x4 == x0 && y4 == y0 && x3 == x1 && y3 == y1 ) { break; }
+        x3 = x4;
+        y3 = y4;
+        s = (s + 4) & 7;
+    }
+}
+
+/// All outer and hole borders, in raster order of their starting pixel,
+/// like findContours( RETR_LIST ) with CHAIN_APPROX_NONE or, when simple,
+/// CHAIN_APPROX_SIMPLE. is_hole, if given, receives 1 for hole borders.
+/// Without hierarchy: contours.hierarchy is left empty. Keeps its marks and
+/// its contour buffer between calls, so once they fit the image nothing is
+/// allocated.
+class PackedContourFinder
+{
+public:
+    void find( const PackedBinary& img, ContourArena& contours,
+               bool simple = true, std::vector<uchar>* is_hole = 0 )
+    {
+        contours.clear();
+        if( is_hole ) { is_hole->clear(); }
+        visited.create( img.rows, img.cols );
+        right.create( img.rows, img.cols );
+
+        for( int y = 0; y < img.rows; y++ )
+        {
+            const uint64* r = img.row(y);
+            const uint64* vis = visited.row(y);
+            const uint64* rgt = right.row(y);
+            for( int w = 0; w < img.step; w++ )
+            {
+                uint64 c = r[w];
+                if( !c ) { continue; }
+                // Pixels whose left (right) neighbour is 0 may start an outer (hole) border
+                uint64 left_zero = c & ~((c << 1) | (w > 0 ? r[w - 1] >> 63 : 0));
+                uint64 right_zero = c & ~((c >> 1) | (w + 1 < img.step ? r[w + 1] << 63 : 0));
+                uint64 from = ~(uint64)0;
+                for( ;; )
+                {
+                    // Tracing updates the marks, so the candidates are recomputed
+                    uint64 outer = left_zero & ~vis[w], inner = right_zero & ~rgt[w];
+                    uint64 next = (outer | inner) & from;
+                    if( !next ) { break; }
+                    int b = lowestBit( next ), x = w * 64 + b;
+                    uint64 bit = (uint64)1 << b;
+
+                    if( outer & bit )
+                    {
+                        tracePackedBorder( img, visited, right, x, y, false, simple, contour );
+                        contours.add( contour );
+                        if( is_hole ) { is_hole->push_back( 0 ); }
+                    }
+                    if( (right_zero & bit) && !(rgt[w] & bit) )
+                    {
+                        tracePackedBorder( img, visited, right, x, y, true, simple, contour );
+                        contours.add( contour );
+                        if( is_hole ) { is_hole->push_back( 1 ); }
+                    }
+                    if( b == 63 ) { break; }
+                    from = ~(uint64)0 << (b + 1);
+                }
+            }
+        }
+    }
+
+private:
+    PackedBinary visited, right;
+    std::vector<cv::Point> contour;
+};
+
+/// One-shot version of PackedContourFinder::find.
+inline void findPackedContours( const PackedBinary& img, ContourArena& contours,
+                                bool simple = true, std::vector<uchar>* is_hole = 0 )
+{
+    PackedContourFinder finder;
+    finder.find( img, contours, simple, is_hole );
+}
+
+inline void findPackedContours( const PackedBinary& img, std::vector< std::vector<cv::Point> >& contours,
+                                bool simple = true, std::vector<uchar>* is_hole = 0 )
+{
+    ContourArena arena;
+    findPackedContours( img, arena, simple, is_hole );
+    arena.copyTo( contours );
+}
+
+/// Writes a binary PBM (P4) file, where set pixels come out white.
+inline bool writePackedPBM( const std::string& filename, const PackedBinary& img )
+{
+    FILE* f = fopen( filename.c_str(), "wb" );
+    if( !f ) { return false; }
+    fprintf( f, "P4\n%d %d\n", img.cols, img.rows );
+
+    // PBM rows are bytes with the leftmost pixel in the top bit and 1 for black
+    uchar reversed[256];
+    for( int i = 0; i < 256; i++ )
+    {
+        int r = 0;
+        for( int b = 0; b < 8; b++ ) { r |= ((i >> b) & 1) << (7 - b); }
+        reversed[i] = (uchar)r;
+    }
+    int row_bytes = (img.cols + 7) / 8;
+    std::vector<uchar> line( row_bytes );
+    bool ok = true;
+    for( int y = 0; y < img.rows && ok; y++ )
+    {
+        const uint64* r = img.row(y);
+        for( int i = 0; i < row_bytes; i++ )
+        { line[i] = (uchar)~reversed[(r[i >> 3] >> (8 * (i & 7))) & 255]; }
+        if( img.cols & 7 ) { line[row_bytes - 1] &= (uchar)(0xff << (8 - (img.cols & 7))); }
+        ok = fwrite( &line[0], 1, row_bytes, f ) == (size_t)row_bytes;
+    }
+    return fclose( f ) == 0 && ok;
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_PACKED_BINARY_HPP
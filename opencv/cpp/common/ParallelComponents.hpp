@@ -0,0 +1,297 @@
+// Connected components of a binary image, with the area, box and centroid
+// of each, on all threads.
+
+// When only blob sizes and boxes are needed, tracing contours and measuring
+// each one afterwards is more than necessary. Two-pass labeling gets them
+// directly:
+//   1. each strip of rows is scanned on its own thread; a 1-pixel takes the
+//      label of a labeled neighbour above or left (8-connectivity), labels
+//      that meet are joined with union-find, and each label's area, box and
+//      coordinate sums are accumulated as it goes
+//   2. the strips' labels are stitched across the seams, every set gets its
+//      final number, in raster order of its first pixel, and its sums are
+//      added up; then the strips are relabeled in parallel
+// Only the pixel whose up neighbour is 0 while its up-right one is set can
+// join two labels (Wu's decision tree); every other case copies a label.
+
+// The components and their statistics are those of
+// connectedComponentsWithStats( src, labels, stats, centroids, 8, CV_32S ),
+// background (label 0) included, but not the numbering: here components are
+// numbered in raster order of their first pixel, while OpenCV's block-based
+// algorithms number them in the order of 2x2 blocks. Labels are therefore
+// the same up to a renumbering.
+
+#ifndef TUTORIALS_PARALLEL_COMPONENTS_HPP
+#define TUTORIALS_PARALLEL_COMPONENTS_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "ParallelContours.hpp"
+#include <algorithm>
+#include <climits>
+#include <vector>
+
+namespace tut
+{
+
+struct ComponentStats
+{
+    int area;                   // pixels
+    cv::Rect bbox;
+    cv::Point2d centroid;       // mean pixel position
+};
+
+/// Sums a component's statistics are made from.
+struct ComponentSums
+{
+    int area, x0, y0, x1, y1;
+    int64 sx, sy;
+
+    void reset()
+    {
+        area = 0;
+        x0 = y0 = INT_MAX;
+        x1 = y1 = INT_MIN;
+        sx = sy = 0;
+    }
+    void add( int x, int y )
+    {
+        area++;
+        x0 = std::min( x0, x );
+        x1 = std::max( x1, x );
+        y0 = std::min( y0, y );
+        y1 = std::max( y1, y );
+        sx += x;
+        sy += y;
+    }
+    void add( const ComponentSums& b )
+    {
+        area += b.area;
+        x0 = std::min( x0, b.x0 );
+        x1 = std::max( x1, b.x1 );
+        y0 = std::min( y0, b.y0 );
+        y1 = std::max( y1, b.y1 );
+        sx += b.sx;
+        sy += b.sy;
+    }
+    void get( ComponentStats& st ) const
+    {
+        st.area = area;
+        st.bbox = area ? cv::Rect( x0, y0, x1 - x0 + 1, y1 - y0 + 1 ) : cv::Rect();
+        st.centroid = area ? cv::Point2d( (double)sx / area, (double)sy / area ) : cv::Point2d();
+    }
+};
+
+/// Provisional labels of one strip, from 1; parent[0] is unused.
+struct ComponentStrip
+{
+    int y0, y1;
+    std::vector<int> parent;
+    std::vector<ComponentSums> sums;
+    ComponentSums background;
+};
+
+class LabelComponentsBody : public cv::ParallelLoopBody
+{
+public:
+    LabelComponentsBody( const cv::Mat& _src, cv::Mat& _labels, std::vector<ComponentStrip>& _strips )
+        : src(_src), labels(_labels), strips(_strips) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols;
+        for( int s = range.start; s < range.end; s++ )
+        {
+            ComponentStrip& st = strips[s];
+            std::vector<int>& parent = st.parent;
+            parent.assign( 1, 0 );
+            st.sums.resize( 1 );
+            st.background.reset();
+
+            for( int y = st.y0; y < st.y1; y++ )
+            {
+                const uchar* p = src.ptr<uchar>(y);
+                const uchar* pu = y > st.y0 ? src.ptr<uchar>(y - 1) : 0;
+                int* l = labels.ptr<int>(y);
+                const int* lu = y > st.y0 ? labels.ptr<int>(y - 1) : 0;
+
+                for( int x = 0; x < width; x++ )
+                {
+                    if( !p[x] )
+                    {
+                        l[x] = 0;
+                        st.background.add( x, y );
+                        continue;
+                    }
+                    // Up, up-left, up-right and left neighbours
+                    bool b = pu && pu[x];
+                    bool a = pu && x > 0 && pu[x - 1];
+                    bool c = pu && x + 1 < width && pu[x + 1];
+                    bool d = x > 0 && p[x - 1];
+                    int label;
+                    if( b ) { label = lu[x]; }
+                    else if( c )
+                    {
+                        label = lu[x + 1];
+                        if( a ) { label = uniteRoots( parent, label, lu[x - 1] ); }
+                        else if( d ) { label = uniteRoots( parent, label, l[x - 1] ); }
+                    }
+                    else if( a ) { label = lu[x - 1]; }
+                    else if( d ) { label = l[x - 1]; }
+                    else
+                    {
+                        label = (int)parent.size();
+                        parent.push_back( label );
+                        st.sums.resize( label + 1 );
+                        st.sums[label].reset();
+                    }
+                    l[x] = label;
+                    st.sums[label].add( x, y );
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& labels;
+    std::vector<ComponentStrip>& strips;
+};
+
+class RelabelComponentsBody : public cv::ParallelLoopBody
+{
+public:
+    RelabelComponentsBody( cv::Mat& _labels, const std::vector<ComponentStrip>& _strips,
+                           const std::vector<int>& _offsets, const std::vector<int>& _numbers )
+        : labels(_labels), strips(_strips), offsets(_offsets), numbers(_numbers) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int s = range.start; s < range.end; s++ )
+        {
+            // Local label l > 0 of strip s is numbers[offsets[s] + l]
+            const int* f = &numbers[0] + offsets[s];
+            for( int y = strips[s].y0; y < strips[s].y1; y++ )
+            {
+                int* l = labels.ptr<int>(y);
+                for( int x = 0; x < labels.cols; x++ ) { l[x] = l[x] ? f[l[x]] : 0; }
+            }
+        }
+    }
+
+private:
+    cv::Mat& labels;
+    const std::vector<ComponentStrip>& strips;
+    const std::vector<int>& offsets;
+    const std::vector<int>& numbers;
+};
+
+/// Labels the 8-connected components of the non zero pixels of a CV_8UC1
+/// image into a CV_32SC1 label image, 0 for the background, and gives each
+/// label's area, box and centroid; returns the number of labels, background
+/// included. The components of connectedComponentsWithStats( src, labels,
+/// stats, centroids, 8, CV_32S ), numbered in raster order of their first
+/// pixel. strip_rows = 0 picks a strip height from the thread count. Keeps
+/// its buffers between calls.
+class ParallelComponentLabeler
+{
+public:
+    int label( const cv::Mat& src, cv::Mat& labels, std::vector<ComponentStats>& stats, int strip_rows = 0 )
+    {
+        CV_Assert( src.type() == CV_8UC1 );
+        int width = src.cols, height = src.rows;
+        labels.create( height, width, CV_32SC1 );
+        stats.assign( 1, ComponentStats() );
+        if( src.empty() ) { return 1; }
+
+        // 1. Every strip on its own
+        if( strip_rows <= 0 )
+        { strip_rows = std::max( 16, height / (cv::getNumThreads() * 4) ); }
+        int nstrips = (height + strip_rows - 1) / strip_rows;
+        strips.resize( nstrips );
+        for( int s = 0; s < nstrips; s++ )
+        {
+            strips[s].y0 = s * strip_rows;
+            strips[s].y1 = std::min( height, (s + 1) * strip_rows );
+        }
+        cv::parallel_for_( cv::Range(0, nstrips), LabelComponentsBody( src, labels, strips ) );
+
+        // 2. Global labels: strip after strip, so in raster order of the
+        //    pixel each was created at; global 0 is the background of all
+        //    strips, and strip s's label l is offsets[s] + l
+        offsets.resize( nstrips );
+        int total = 1;
+        for( int s = 0; s < nstrips; s++ )
+        {
+            offsets[s] = total - 1;
+            total += (int)strips[s].parent.size() - 1;
+        }
+        parent.resize( total );
+        parent[0] = 0;
+        for( int s = 0; s < nstrips; s++ )
+        {
+            const std::vector<int>& p = strips[s].parent;
+            for( int l = 1; l < (int)p.size(); l++ ) { parent[offsets[s] + l] = offsets[s] + p[l]; }
+        }
+
+        // 3. Stitch across the seams, 8-connected
+        for( int s = 1; s < nstrips; s++ )
+        {
+            int y = strips[s].y0;
+            const uchar* p = src.ptr<uchar>(y);
+            const uchar* pu = src.ptr<uchar>(y - 1);
+            const int* l = labels.ptr<int>(y);
+            const int* lu = labels.ptr<int>(y - 1);
+            for( int x = 0; x < width; x++ )
+            {
+                if( !p[x] ) { continue; }
+                for( int dx = -1; dx <= 1; dx++ )
+                {
+                    int xx = x + dx;
+                    if( (unsigned)xx < (unsigned)width && pu[xx] )
+                    { uniteRoots( parent, offsets[s] + l[x], offsets[s - 1] + lu[xx] ); }
+                }
+            }
+        }
+
+        // 4. Final numbers for the roots, in order; sums added up by them
+        numbers.resize( total );
+        numbers[0] = 0;
+        int n = 1;
+        for( int g = 1; g < total; g++ )
+        {
+            parent[g] = parent[parent[g]];
+            numbers[g] = parent[g] == g ? n++ : numbers[parent[g]];
+        }
+        sums.resize( n );
+        for( int i = 0; i < n; i++ ) { sums[i].reset(); }
+        for( int s = 0; s < nstrips; s++ )
+        {
+            const ComponentStrip& st = strips[s];
+            sums[0].add( st.background );
+            for( int l = 1; l < (int)st.parent.size(); l++ ) { sums[numbers[offsets[s] + l]].add( st.sums[l] ); }
+        }
+        stats.resize( n );
+        for( int i = 0; i < n; i++ ) { sums[i].get( stats[i] ); }
+
+        // 5. Final labels into the image
+        cv::parallel_for_( cv::Range(0, nstrips), RelabelComponentsBody( labels, strips, offsets, numbers ) );
+        return n;
+    }
+
+private:
+    std::vector<ComponentStrip> strips;
+    std::vector<int> offsets, parent, numbers;
+    std::vector<ComponentSums> sums;
+};
+
+/// One-shot version of ParallelComponentLabeler::label.
+inline int connectedComponentsParallel( const cv::Mat& src, cv::Mat& labels, std::vector<ComponentStats>& stats )
+{
+    ParallelComponentLabeler labeler;
+    return labeler.label( src, labels, stats );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_PARALLEL_COMPONENTS_HPP
@@ -0,0 +1,522 @@
+// findContours( RETR_TREE ) split across threads.
+
+// findContours (Suzuki-Abe border following) scans the image once, tracing
+// each border as it meets it and marking what it traced so that no border
+// is started twice. The marks make the scan sequential. But where every
+// border starts, and which border contains which, only depends on the
+// connected components of the image:
+//   - each 8-connected component C of 1-pixels has one outer border, which
+//     starts at C's first pixel in raster order
+//   - each 4-connected component B of 0-pixels not connected to the image
+//     frame is a hole, whose border starts at the pixel left of B's first
+//     pixel, in the component surrounding B
+//   - a hole border's parent is the outer border of the component around
+//     it; an outer border's parent is the border of the hole it lies in
+//     (none when it lies in the background connected to the frame)
+// So the image is labeled instead, in horizontal strips on all threads;
+// labels meeting across a strip seam are stitched with union-find. Once a
+// border's start is known, tracing it only reads the image, so all borders
+// are then traced in parallel.
+
+// Contours, their points and the hierarchy are those of findContours (with
+// the image treated as surrounded by 0), listed in the order the raster
+// scan meets their start.
+
+#ifndef TUTORIALS_PARALLEL_CONTOURS_HPP
+#define TUTORIALS_PARALLEL_CONTOURS_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "ContourArena.hpp"
+#include "ContourStats.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace tut
+{
+
+/// Root of i in a union-find forest where parents always have smaller
+/// labels, halving the path on the way.
+inline int findRoot( std::vector<int>& parent, int i )
+{
+    while( parent[i] < i )
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+/// Joins the sets of a and b under the smaller root, which is returned.
+inline int uniteRoots( std::vector<int>& parent, int a, int b )
+{
+    a = findRoot( parent, a );
+    b = findRoot( parent, b );
+    if( a < b ) { parent[b] = a; return a; }
+    parent[a] = b;
+    return b;
+}
+
+/// Labels of one strip of rows, numbered locally. Label 1 stands for the
+/// background connected to the image frame; new labels start at 2.
+struct StripLabels
+{
+    int y0, y1;
+    std::vector<int> parent;
+    std::vector<int> first;     // pixel index (y * cols + x) the label was created at
+    std::vector<uchar> fg;      // 1 for components of 1-pixels
+};
+
+class LabelStripsBody : public cv::ParallelLoopBody
+{
+public:
+    LabelStripsBody( const cv::Mat& _src, cv::Mat& _labels, std::vector<StripLabels>& _strips )
+        : src(_src), labels(_labels), strips(_strips) {}
+
+    /// First labeling pass over each strip: 8-connectivity for 1-pixels,
+    /// 4-connectivity for 0-pixels, nothing looked at above the strip.
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols, height = src.rows;
+        for( int s = range.start; s < range.end; s++ )
+        {
+            StripLabels& st = strips[s];
+            std::vector<int>& parent = st.parent;
+            parent.assign( 2, 0 );
+            parent[1] = 1;
+            st.first.assign( 2, -1 );
+            st.fg.assign( 2, 0 );
+
+            for( int y = st.y0; y < st.y1; y++ )
+            {
+                const uchar* p = src.ptr<uchar>(y);
+                const uchar* pu = y > st.y0 ? src.ptr<uchar>(y - 1) : 0;
+                int* l = labels.ptr<int>(y);
+                const int* lu = y > st.y0 ? labels.ptr<int>(y - 1) : 0;
+                bool frame_row = y == 0 || y == height - 1;
+
+                for( int x = 0; x < width; x++ )
+                {
+                    bool v = p[x] != 0;
+                    int label = 0;
+                    if( v )
+                    {
+                        if( x > 0 && p[x - 1] ) { label = l[x - 1]; }
+                        if( pu )
+                        {
+                            for( int dx = -1; dx <= 1; dx++ )
+                            {
+                                int xx = x + dx;
+                                if( (unsigned)xx < (unsigned)width && pu[xx] )
+                                { label = label ? uniteRoots( parent, label, lu[xx] ) : lu[xx]; }
+                            }
+                        }
+                    }
+                    else
+                    {
+                        if( x > 0 && !p[x - 1] ) { label = l[x - 1]; }
+                        if( pu && !pu[x] )
+                        { label = label ? uniteRoots( parent, label, lu[x] ) : lu[x]; }
+                        if( frame_row || x == 0 || x == width - 1 )
+                        { label = label ? uniteRoots( parent, label, 1 ) : 1; }
+                    }
+                    if( !label )
+                    {
+                        label = (int)parent.size();
+                        parent.push_back( label );
+                        st.first.push_back( y * width + x );
+                        st.fg.push_back( v );
+                    }
+                    l[x] = label;
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& labels;
+    std::vector<StripLabels>& strips;
+};
+
+/// Follows the border starting at `start` (in image coordinates) through a
+/// copy of the image with a one pixel 0 frame, as findContours does, and
+/// appends its points to contour. stats, if given, receives the contour's
+/// statistics, gathered on the way.
+inline void traceBorder( const cv::Mat& padded, cv::Point start, bool hole, bool simple,
+                         std::vector<cv::Point>& contour, ContourStats* stats = 0 )
+{
+    static const int dx[8] = { 1, 1, 0, -1, -1, -1, 0, 1 };
+    static const int dy[8] = { 0, -1, -1, -1, 0, 1, 1, 1 };
+    int step = (int)padded.step;
+    int deltas[16];
+    for( int k = 0; k < 8; k++ )
+    { deltas[k] = deltas[k + 8] = dy[k] * step + dx[k]; }
+
+    const uchar* i0 = padded.ptr<uchar>(start.y + 1) + start.x + 1;
+    int s = hole ? 0 : 4, s_end = s;
+    const uchar* i1;
+    do
+    {
+        s = (s - 1) & 7;
+        i1 = i0 + deltas[s];
+    }
+    while( *i1 == 0 && s != s_end );
+
+    ContourStatsAccumulator acc;
+    if( s == s_end )
+    {
+        contour.push_back( start );
+        if( stats )
+        {
+            acc.start( start );
+            acc.finish( *stats );
+        }
+        return;
+    }
+
+    const uchar* i3 = i0;
+    cv::Point pt = start;
+    int prev_s = s ^ 4;
+    size_t n0 = contour.size();
+    for( ;; )
+    {
+        s_end = s;
+        const uchar* i4;
+        do { i4 = i3 + deltas[++s]; }
+        while( *i4 == 0 );
+        s &= 7;
+
+        if( !simple || s != prev_s )
+        {
+            if( stats )
+            {
+                if( contour.size() == n0 ) { acc.start( pt ); }
+                else { acc.add( pt ); }
+            }
+            contour.push_back( pt );
+            prev_s = s;
+        }
+        pt.x += dx[s];
+        pt.y += dy[s];
+
+        if( i4 == i0 && i3 == i1 ) { break; }
+        i3 = i4;
+        s = (s + 4) & 7;
+    }
+    if( stats ) { acc.finish( *stats ); }
+}
+
+struct BorderStart
+{
+    int key;            // raster position where the scan meets the border
+    cv::Point start;
+    bool hole;
+    int parent;         // index into the border list, -1 for none
+};
+
+class TraceBordersBody : public cv::ParallelLoopBody
+{
+public:
+    TraceBordersBody( const cv::Mat& _padded, const std::vector<BorderStart>& _borders, bool _simple,
+                      std::vector< std::vector<cv::Point> >& _contours, ContourStats* _stats )
+        : padded(_padded), borders(_borders), simple(_simple), contours(_contours), stats(_stats) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int i = range.start; i < range.end; i++ )
+        {
+            contours[i].clear();
+            traceBorder( padded, borders[i].start, borders[i].hole, simple, contours[i],
+                         stats ? stats + i : 0 );
+        }
+    }
+
+private:
+    const cv::Mat& padded;
+    const std::vector<BorderStart>& borders;
+    bool simple;
+    std::vector< std::vector<cv::Point> >& contours;
+    ContourStats* stats;
+};
+
+/// Traces the borders of chunk c, borders first[c] to first[c + 1] - 1, one
+/// after the other into points[c], and their lengths into lengths.
+class TraceChunksBody : public cv::ParallelLoopBody
+{
+public:
+    TraceChunksBody( const cv::Mat& _padded, const std::vector<BorderStart>& _borders, bool _simple,
+                     const std::vector<int>& _first, std::vector< std::vector<cv::Point> >& _points,
+                     std::vector<int>& _lengths, ContourStats* _stats )
+        : padded(_padded), borders(_borders), simple(_simple), first(_first), points(_points),
+          lengths(_lengths), stats(_stats) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int c = range.start; c < range.end; c++ )
+        {
+            std::vector<cv::Point>& pts = points[c];
+            pts.clear();
+            for( int i = first[c]; i < first[c + 1]; i++ )
+            {
+                size_t n = pts.size();
+                traceBorder( padded, borders[i].start, borders[i].hole, simple, pts,
+                             stats ? stats + i : 0 );
+                lengths[i] = (int)(pts.size() - n);
+            }
+        }
+    }
+
+private:
+    const cv::Mat& padded;
+    const std::vector<BorderStart>& borders;
+    bool simple;
+    const std::vector<int>& first;
+    std::vector< std::vector<cv::Point> >& points;
+    std::vector<int>& lengths;
+    ContourStats* stats;
+};
+
+/// Copies every chunk's points to its place in the arena.
+class CopyChunksBody : public cv::ParallelLoopBody
+{
+public:
+    CopyChunksBody( const std::vector<int>& _first, const std::vector< std::vector<cv::Point> >& _points,
+                    ContourArena& _dst )
+        : first(_first), points(_points), dst(_dst) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        for( int c = range.start; c < range.end; c++ )
+        {
+            if( !points[c].empty() )
+            { std::copy( points[c].begin(), points[c].end(), dst.points.begin() + dst.offsets[first[c]] ); }
+        }
+    }
+
+private:
+    const std::vector<int>& first;
+    const std::vector< std::vector<cv::Point> >& points;
+    ContourArena& dst;
+};
+
+/// findContours( src, contours, hierarchy, RETR_TREE, CHAIN_APPROX_SIMPLE
+/// or, with simple = false, CHAIN_APPROX_NONE ) for a CV_8UC1 image, any
+/// non zero pixel counting as 1. strip_rows = 0 picks a strip height from
+/// the thread count. stats, if given, receives each contour's area,
+/// perimeter, box and moments, gathered while tracing. Keeps its buffers
+/// between calls.
+class ParallelContourFinder
+{
+public:
+    void find( const cv::Mat& src, std::vector< std::vector<cv::Point> >& contours,
+               std::vector<cv::Vec4i>& hierarchy, bool simple = true, int strip_rows = 0,
+               std::vector<ContourStats>* stats = 0 )
+    {
+        locate( src, strip_rows );
+        contours.resize( borders.size() );
+        if( stats ) { stats->resize( borders.size() ); }
+        cv::parallel_for_( cv::Range(0, (int)borders.size()),
+                TraceBordersBody( padded, borders, simple, contours, statsData( stats ) ),
+                std::max( 1, (int)borders.size() / 16 ) );
+        makeHierarchy( hierarchy );
+    }
+
+    /// The same into an arena; once it has grown to the usual frame, the
+    /// finder and the arena allocate nothing more.
+    void find( const cv::Mat& src, ContourArena& contours, bool simple = true, int strip_rows = 0,
+               std::vector<ContourStats>* stats = 0 )
+    {
+        locate( src, strip_rows );
+        int n = (int)borders.size();
+        if( stats ) { stats->resize( n ); }
+
+        // Chunks of borders traced one after the other into a buffer each,
+        // so the offsets are only known after tracing
+        int nchunks = std::min( n, cv::getNumThreads() * 8 );
+        chunk_first.resize( nchunks + 1 );
+        for( int c = 0; c <= nchunks; c++ ) { chunk_first[c] = (int)((int64)n * c / std::max( nchunks, 1 )); }
+        chunk_points.resize( std::max( (int)chunk_points.size(), nchunks ) );
+        lengths.resize( n );
+        cv::parallel_for_( cv::Range(0, nchunks),
+                TraceChunksBody( padded, borders, simple, chunk_first, chunk_points, lengths,
+                                 statsData( stats ) ) );
+
+        contours.offsets.resize( n + 1 );
+        contours.offsets[0] = 0;
+        for( int i = 0; i < n; i++ ) { contours.offsets[i + 1] = contours.offsets[i] + lengths[i]; }
+        contours.points.resize( contours.offsets[n] );
+        cv::parallel_for_( cv::Range(0, nchunks), CopyChunksBody( chunk_first, chunk_points, contours ) );
+        makeHierarchy( contours.hierarchy );
+    }
+
+private:
+    static ContourStats* statsData( std::vector<ContourStats>* stats )
+    { return stats && !stats->empty() ? &(*stats)[0] : 0; }
+
+    /// Finds where every border starts and its parent.
+    void locate( const cv::Mat& src, int strip_rows )
+    {
+        CV_Assert( src.type() == CV_8UC1 );
+        int width = src.cols, height = src.rows;
+        borders.clear();
+        if( src.empty() ) { return; }
+
+        // 1. Label every strip on its own
+        if( strip_rows <= 0 )
+        { strip_rows = std::max( 16, height / (cv::getNumThreads() * 4) ); }
+        int nstrips = (height + strip_rows - 1) / strip_rows;
+        strips.resize( nstrips );
+        for( int s = 0; s < nstrips; s++ )
+        {
+            strips[s].y0 = s * strip_rows;
+            strips[s].y1 = std::min( height, (s + 1) * strip_rows );
+        }
+        labels.create( height, width, CV_32SC1 );
+        cv::parallel_for_( cv::Range(0, nstrips), LabelStripsBody( src, labels, strips ) );
+
+        // 2. Global labels: 0 is the frame background, then every strip's
+        //    own labels in order, which keeps them in raster order of the
+        //    pixel they were created at, so each root is its component's
+        //    first pixel
+        offsets.resize( nstrips + 1 );
+        offsets[0] = 1;
+        for( int s = 0; s < nstrips; s++ )
+        { offsets[s + 1] = offsets[s] + (int)strips[s].parent.size() - 2; }
+        int total = offsets[nstrips];
+        parent.resize( total );
+        first.resize( total );
+        fg.resize( total );
+        parent[0] = 0;
+        first[0] = -1;
+        fg[0] = 0;
+        for( int s = 0; s < nstrips; s++ )
+        {
+            const StripLabels& st = strips[s];
+            for( int l = 2; l < (int)st.parent.size(); l++ )
+            {
+                int g = offsets[s] + l - 2;
+                parent[g] = global( s, st.parent[l] );
+                first[g] = st.first[l];
+                fg[g] = st.fg[l];
+            }
+        }
+
+        // 3. Stitch across the seams, the first row of a strip against the
+        //    last one of the strip above
+        for( int s = 1; s < nstrips; s++ )
+        {
+            int y = strips[s].y0;
+            const uchar* p = src.ptr<uchar>(y);
+            const uchar* pu = src.ptr<uchar>(y - 1);
+            const int* l = labels.ptr<int>(y);
+            const int* lu = labels.ptr<int>(y - 1);
+            for( int x = 0; x < width; x++ )
+            {
+                if( p[x] )
+                {
+                    for( int dx = -1; dx <= 1; dx++ )
+                    {
+                        int xx = x + dx;
+                        if( (unsigned)xx < (unsigned)width && pu[xx] )
+                        { uniteRoots( parent, global( s, l[x] ), global( s - 1, lu[xx] ) ); }
+                    }
+                }
+                else if( !pu[x] )
+                { uniteRoots( parent, global( s, l[x] ), global( s - 1, lu[x] ) ); }
+            }
+        }
+        for( int g = 1; g < total; g++ ) { parent[g] = parent[parent[g]]; }
+
+        // 4. One border per component except the frame background
+        borders.clear();
+        border_of.assign( total, -1 );
+        enclosing.assign( total, 0 );
+        for( int g = 1; g < total; g++ )
+        {
+            if( parent[g] != g ) { continue; }
+            int x = first[g] % width, y = first[g] / width;
+            BorderStart b;
+            b.hole = !fg[g];
+            b.start = b.hole ? cv::Point( x - 1, y ) : cv::Point( x, y );
+            b.key = y * (width + 1) + x;
+            b.parent = -1;
+            // The component on the other side of the border, left of its first pixel
+            enclosing[g] = x > 0 ? parent[labelAt( x - 1, y )] : 0;
+            border_of[g] = (int)borders.size();
+            borders.push_back( b );
+        }
+
+        // Raster order; then the parents, once the indices are final
+        order.resize( borders.size() );
+        for( size_t i = 0; i < order.size(); i++ ) { order[i] = (int)i; }
+        std::sort( order.begin(), order.end(), KeyLess( borders ) );
+        rank.resize( borders.size() );
+        sorted.resize( borders.size() );
+        for( size_t i = 0; i < order.size(); i++ )
+        {
+            rank[order[i]] = (int)i;
+            sorted[i] = borders[order[i]];
+        }
+        for( int g = 1; g < total; g++ )
+        {
+            if( border_of[g] < 0 ) { continue; }
+            int e = enclosing[g];
+            sorted[rank[border_of[g]]].parent = e ? rank[border_of[e]] : -1;
+        }
+        borders.swap( sorted );
+
+        // 5. The borders are then traced in this copy, in parallel
+        cv::copyMakeBorder( src, padded, 1, 1, 1, 1, cv::BORDER_CONSTANT, cv::Scalar::all( 0 ) );
+    }
+
+    /// Hierarchy as findContours lays it out: next, previous, first child, parent.
+    void makeHierarchy( std::vector<cv::Vec4i>& hierarchy )
+    {
+        hierarchy.assign( borders.size(), cv::Vec4i( -1, -1, -1, -1 ) );
+        last_child.assign( borders.size() + 1, -1 );
+        for( int i = 0; i < (int)borders.size(); i++ )
+        {
+            int p = borders[i].parent;
+            int& last = last_child[p + 1];
+            hierarchy[i][3] = p;
+            if( last >= 0 )
+            {
+                hierarchy[last][0] = i;
+                hierarchy[i][1] = last;
+            }
+            else if( p >= 0 )
+            { hierarchy[p][2] = i; }
+            last = i;
+        }
+    }
+
+    struct KeyLess
+    {
+        KeyLess( const std::vector<BorderStart>& _b ) : b(_b) {}
+        bool operator()( int i, int j ) const { return b[i].key < b[j].key; }
+        const std::vector<BorderStart>& b;
+    };
+
+    int global( int s, int local ) const
+    { return local == 1 ? 0 : offsets[s] + local - 2; }
+
+    int labelAt( int x, int y ) const
+    {
+        int s = y / (strips[0].y1 - strips[0].y0);
+        return global( s, labels.at<int>(y, x) );
+    }
+
+    std::vector<StripLabels> strips;
+    cv::Mat labels, padded;
+    std::vector<int> offsets, parent, first, border_of, enclosing;
+    std::vector<int> order, rank, last_child, chunk_first, lengths;
+    std::vector<uchar> fg;
+    std::vector<BorderStart> borders, sorted;
+    std::vector< std::vector<cv::Point> > chunk_points;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_PARALLEL_CONTOURS_HPP
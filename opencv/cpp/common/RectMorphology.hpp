@@ -0,0 +1,257 @@
+// Erode and dilate with rectangles of any size at a fixed cost per pixel.
+
+// A rectangular element is separable: a k-wide horizontal min (max) followed
+// by an h-tall vertical one. Each 1D pass uses the van Herk / Gil-Werman
+// algorithm: the line is cut into blocks of k, and within every block
+//   g[i] = op( g[i-1], p[i] )     running from the block start
+//   h[i] = op( h[i+1], p[i] )     running from the block end
+// Any window of k values covers the end of one block and the start of the
+// next, so its result is op( h[first], g[last] ): three comparisons per pixel
+// whatever k is.
+
+// The vertical pass runs down strips of columns, 16 columns per SSE2
+// instruction. The horizontal pass is the vertical pass on the transposed
+// image; transposing goes by 16 x 16 tiles, each done in registers.
+
+// Outside the image is +inf for erode and -inf for dilate, as with the
+// default border of cv::erode / cv::dilate, so results are the same.
+
+#ifndef TUTORIALS_RECT_MORPHOLOGY_HPP
+#define TUTORIALS_RECT_MORPHOLOGY_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+class Transpose8uBody : public cv::ParallelLoopBody
+{
+public:
+    Transpose8uBody( const cv::Mat& _src, cv::Mat& _dst ) : src(_src), dst(_dst) {}
+
+    /// One band of 16 source rows per iteration.
+    void operator()( const cv::Range& range ) const
+    {
+        for( int b = range.start; b < range.end; b++ )
+        {
+            int y0 = b * 16, y1 = std::min( y0 + 16, src.rows );
+            int x = 0;
+#if CV_SSE2
+            if( y1 - y0 == 16 )
+            {
+                for( ; x <= src.cols - 16; x += 16 )
+                {
+                    __m128i r[16];
+                    for( int i = 0; i < 16; i++ )
+                    { r[i] = _mm_loadu_si128( (const __m128i*)(src.ptr<uchar>(y0 + i) + x) ); }
+                    transpose16x16( r );
+                    for( int i = 0; i < 16; i++ )
+                    { _mm_storeu_si128( (__m128i*)(dst.ptr<uchar>(x + i) + y0), r[i] ); }
+                }
+            }
+#endif
+            for( ; x < src.cols; x++ )
+            {
+                uchar* d = dst.ptr<uchar>(x);
+                for( int y = y0; y < y1; y++ ) { d[y] = src.ptr<uchar>(y)[x]; }
+            }
+        }
+    }
+
+#if CV_SSE2
+    /// In-register transpose: four rounds of interleaving, 8, 16, 32 and 64 bits wide.
+    static void transpose16x16( __m128i* r )
+    {
+        __m128i t[16];
+        for( int i = 0; i < 8; i++ )
+        {
+            t[i] = _mm_unpacklo_epi8( r[2 * i], r[2 * i + 1] );
+            t[i + 8] = _mm_unpackhi_epi8( r[2 * i], r[2 * i + 1] );
+        }
+        for( int i = 0; i < 4; i++ )
+        {
+            r[i] = _mm_unpacklo_epi16( t[2 * i], t[2 * i + 1] );
+            r[i + 4] = _mm_unpackhi_epi16( t[2 * i], t[2 * i + 1] );
+            r[i + 8] = _mm_unpacklo_epi16( t[2 * i + 8], t[2 * i + 9] );
+            r[i + 12] = _mm_unpackhi_epi16( t[2 * i + 8], t[2 * i + 9] );
+        }
+        for( int j = 0; j < 4; j++ )
+        {
+            for( int i = 0; i < 2; i++ )
+            {
+                t[4 * j + i] = _mm_unpacklo_epi32( r[4 * j + 2 * i], r[4 * j + 2 * i + 1] );
+                t[4 * j + i + 2] = _mm_unpackhi_epi32( r[4 * j + 2 * i], r[4 * j + 2 * i + 1] );
+            }
+        }
+        // t[2c] and t[2c+1] hold columns 2c and 2c+1, rows 0-7 and 8-15
+        for( int i = 0; i < 8; i++ )
+        {
+            r[2 * i] = _mm_unpacklo_epi64( t[2 * i], t[2 * i + 1] );
+            r[2 * i + 1] = _mm_unpackhi_epi64( t[2 * i], t[2 * i + 1] );
+        }
+    }
+#endif
+
+private:
+    const cv::Mat& src;
+    cv::Mat& dst;
+};
+
+/// dst = src transposed, for 8-bit single channel images.
+inline void transpose8u( const cv::Mat& src, cv::Mat& dst )
+{
+    CV_Assert( src.type() == CV_8UC1 && src.data != dst.data );
+    dst.create( src.cols, src.rows, CV_8UC1 );
+    cv::parallel_for_( cv::Range(0, (src.rows + 15) / 16), Transpose8uBody( src, dst ) );
+}
+
+/// Vertical van Herk / Gil-Werman min or max over ksize rows, one strip of
+/// columns per iteration.
+class VhgwColsBody : public cv::ParallelLoopBody
+{
+public:
+    enum { STRIP = 64 };
+
+    VhgwColsBody( const cv::Mat& _src, cv::Mat& _dst, int _ksize, bool _dilate, std::vector<uchar>& _scratch )
+        : src(_src), dst(_dst), ksize(_ksize), dilate(_dilate), scratch(_scratch) {}
+
+    /// Padded line: r border rows, the image, then border rows up to a
+    /// whole number of blocks.
+    static int paddedLength( int rows, int k ) { return (rows + k - 1 + k - 1) / k * k; }
+
+    /// Scratch bytes per strip: the suffix rows, then one row each for the
+    /// prefix and the border.
+    static size_t scratchSize( int rows, int k ) { return ((size_t)paddedLength( rows, k ) + 2) * STRIP; }
+
+    void operator()( const cv::Range& range ) const
+    {
+        int k = ksize, r = k / 2, n = src.rows;
+        int len = paddedLength( n, k );
+
+        for( int s = range.start; s < range.end; s++ )
+        {
+            int x0 = s * STRIP, w = std::min( (int)STRIP, src.cols - x0 );
+            uchar* h = &scratch[0] + s * scratchSize( n, k );
+            uchar* g = h + (size_t)len * STRIP;
+            uchar* pad = g + STRIP;
+            memset( pad, dilate ? 0 : 255, STRIP );
+
+            // Backward: suffix min / max within each block
+            const uchar* next = 0;
+            for( int i = len - 1; i >= 0; i-- )
+            {
+                const uchar* p = line( i - r, x0, pad );
+                uchar* hi = h + (size_t)i * STRIP;
+                if( i % k == k - 1 ) { memcpy( hi, p, w ); }
+                else { combine( next, p, hi, w ); }
+                next = hi;
+            }
+
+            // Forward: prefix min / max, and each window as op( h[first], g[last] )
+            for( int i = 0; i < n + k - 1; i++ )
+            {
+                const uchar* p = line( i - r, x0, pad );
+                if( i % k == 0 ) { memcpy( g, p, w ); }
+                else { combine( g, p, g, w ); }
+                int y = i - (k - 1);
+                if( y >= 0 )
+                { combine( h + (size_t)y * STRIP, g, dst.ptr<uchar>(y) + x0, w ); }
+            }
+        }
+    }
+
+private:
+    /// Row i of the source at column x0, or the border row outside the image.
+    const uchar* line( int i, int x0, const uchar* pad ) const
+    { return (unsigned)i < (unsigned)src.rows ? src.ptr<uchar>(i) + x0 : pad; }
+
+    void combine( const uchar* a, const uchar* b, uchar* d, int w ) const
+    {
+        int x = 0;
+#if CV_SSE2
+        for( ; x <= w - 16; x += 16 )
+        {
+            __m128i va = _mm_loadu_si128( (const __m128i*)(a + x) );
+            __m128i vb = _mm_loadu_si128( (const __m128i*)(b + x) );
+            _mm_storeu_si128( (__m128i*)(d + x), dilate ? _mm_max_epu8( va, vb ) : _mm_min_epu8( va, vb ) );
+        }
+#endif
+        for( ; x < w; x++ )
+        { d[x] = dilate ? std::max( a[x], b[x] ) : std::min( a[x], b[x] ); }
+    }
+
+    const cv::Mat& src;
+    cv::Mat& dst;
+    int ksize;
+    bool dilate;
+    std::vector<uchar>& scratch;
+};
+
+/// Erode, dilate, open or close with a ksize rectangle centered on the pixel,
+/// for 8-bit single channel images; the same as cv::morphologyEx with
+/// getStructuringElement( MORPH_RECT, ksize ) and the default border, but
+/// with a cost that does not depend on ksize. Keeps its buffers between calls.
+class RectMorphology
+{
+public:
+    void apply( const cv::Mat& src, cv::Mat& dst, int op, cv::Size ksize )
+    {
+        CV_Assert( src.type() == CV_8UC1 && ksize.width > 0 && ksize.height > 0 );
+        switch( op )
+        {
+        case cv::MORPH_ERODE:  run( src, dst, false, ksize ); break;
+        case cv::MORPH_DILATE: run( src, dst, true, ksize ); break;
+        case cv::MORPH_OPEN:   run( src, tmp2, false, ksize ); run( tmp2, dst, true, ksize ); break;
+        case cv::MORPH_CLOSE:  run( src, tmp2, true, ksize ); run( tmp2, dst, false, ksize ); break;
+        default: CV_Assert( op == cv::MORPH_ERODE || op == cv::MORPH_DILATE ||
+                            op == cv::MORPH_OPEN || op == cv::MORPH_CLOSE );
+        }
+    }
+
+private:
+    void run( const cv::Mat& src, cv::Mat& dst, bool dilate, cv::Size ksize )
+    {
+        // Vertical pass into a transposed copy, horizontal pass as a
+        // vertical one on it, then back
+        cols( src, vert, ksize.height, dilate );
+        transpose8u( vert, t );
+        cols( t, t2, ksize.width, dilate );
+        dst.create( src.rows, src.cols, CV_8UC1 );
+        transpose8u( t2, dst );
+    }
+
+    void cols( const cv::Mat& src, cv::Mat& dst, int k, bool dilate )
+    {
+        if( k == 1 )
+        {
+            src.copyTo( dst );
+            return;
+        }
+        dst.create( src.rows, src.cols, CV_8UC1 );
+        int strips = (src.cols + VhgwColsBody::STRIP - 1) / VhgwColsBody::STRIP;
+        // Each strip has its own part of one buffer, kept between calls
+        scratch.resize( strips * VhgwColsBody::scratchSize( src.rows, k ) );
+        cv::parallel_for_( cv::Range(0, strips), VhgwColsBody( src, dst, k, dilate, scratch ) );
+    }
+
+    cv::Mat vert, t, t2, tmp2;
+    std::vector<uchar> scratch;
+};
+
+/// One-shot version of RectMorphology::apply.
+inline void rectMorphology( const cv::Mat& src, cv::Mat& dst, int op, cv::Size ksize )
+{
+    RectMorphology morph;
+    morph.apply( src, dst, op, ksize );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_RECT_MORPHOLOGY_HPP
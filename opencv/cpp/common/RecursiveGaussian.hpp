@@ -0,0 +1,223 @@
+// Recursive (IIR) Gaussian blur, Young & van Vliet, 1995.
+
+// A Gaussian is approximated by a third-order causal filter run forwards
+// along a line, followed by the same filter run backwards:
+//   w[n] = B x[n] + b1 w[n-1] + b2 w[n-2] + b3 w[n-3]
+//   y[n] = B w[n] + b1 y[n+1] + b2 y[n+2] + b3 y[n+3]
+// The coefficients depend on sigma, but the number of operations per pixel
+// does not, so a sigma of 20 costs the same as a sigma of 1.
+
+// Columns are filtered first, a whole row at a time, so consecutive x values
+// sit in one SSE2 register. Rows are then filtered on transposed tiles: four
+// rows are interleaved so that the four values needed at each x again share
+// one register. Both passes are split across threads with parallel_for_.
+
+// Borders are reflected (BORDER_REFLECT_101, the GaussianBlur default) far
+// enough for the filter response to settle before the first real pixel.
+
+#ifndef TUTORIALS_RECURSIVE_GAUSSIAN_HPP
+#define TUTORIALS_RECURSIVE_GAUSSIAN_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// The sigma GaussianBlur uses when it is given a kernel size and sigma 0.
+inline double gaussianSigma( int ksize )
+{
+    return 0.3 * ((ksize - 1) * 0.5 - 1) + 0.8;
+}
+
+/// Normalized recursion coefficients for one sigma.
+struct RecursiveGaussianCoeffs
+{
+    float B, b1, b2, b3;
+
+    explicit RecursiveGaussianCoeffs( double sigma )
+    {
+        sigma = std::max( sigma, 0.5 );
+        double q = sigma >= 2.5 ? 0.98711 * sigma - 0.96330
+                                : 3.97156 - 4.14554 * std::sqrt( 1 - 0.26891 * sigma );
+        double q2 = q * q, q3 = q2 * q;
+        double a0 = 1.57825 + 2.44413 * q + 1.4281 * q2 + 0.422205 * q3;
+        double a1 = 2.44413 * q + 2.85619 * q2 + 1.26661 * q3;
+        double a2 = -(1.4281 * q2 + 1.26661 * q3);
+        double a3 = 0.422205 * q3;
+        b1 = (float)(a1 / a0);
+        b2 = (float)(a2 / a0);
+        b3 = (float)(a3 / a0);
+        B = 1.f - (b1 + b2 + b3);
+    }
+};
+
+/// One step of the recursion on a line of `lanes` floats: p = B p + sum bk pk.
+inline void recursiveGaussianStep( float* p, const float* p1, const float* p2,
+                                   const float* p3, int lanes,
+                                   const RecursiveGaussianCoeffs& k )
+{
+    int x = 0;
+#if CV_SSE2
+    __m128 B = _mm_set1_ps( k.B ), b1 = _mm_set1_ps( k.b1 );
+    __m128 b2 = _mm_set1_ps( k.b2 ), b3 = _mm_set1_ps( k.b3 );
+    for( ; x <= lanes - 4; x += 4 )
+    {
+        __m128 w = _mm_add_ps( _mm_mul_ps( B, _mm_loadu_ps( p + x ) ),
+                   _mm_add_ps( _mm_mul_ps( b1, _mm_loadu_ps( p1 + x ) ),
+                   _mm_add_ps( _mm_mul_ps( b2, _mm_loadu_ps( p2 + x ) ),
+                               _mm_mul_ps( b3, _mm_loadu_ps( p3 + x ) ) ) ) );
+        _mm_storeu_ps( p + x, w );
+    }
+#endif
+    for( ; x < lanes; x++ )
+    { p[x] = k.B * p[x] + k.b1 * p1[x] + k.b2 * p2[x] + k.b3 * p3[x]; }
+}
+
+/// Runs the forward then backward recursion, in place, down n lines of
+/// `lanes` floats spaced `step` floats apart. Each line is updated as a whole
+/// from the lines before it, so the inner loop is plain SIMD over x.
+/// Lines past either end are clamped to the end line, which starts the filter
+/// in the steady state of a constant signal (the end line itself is unchanged).
+inline void recursiveGaussianLines( float* buf, size_t step, int n, int lanes,
+                                    const RecursiveGaussianCoeffs& k )
+{
+    for( int i = 1; i < n; i++ )
+    {
+        recursiveGaussianStep( buf + i * step, buf + (i - 1) * step,
+                buf + std::max( i - 2, 0 ) * step, buf + std::max( i - 3, 0 ) * step,
+                lanes, k );
+    }
+    for( int i = n - 2; i >= 0; i-- )
+    {
+        recursiveGaussianStep( buf + i * step, buf + (i + 1) * step,
+                buf + std::min( i + 2, n - 1 ) * step, buf + std::min( i + 3, n - 1 ) * step,
+                lanes, k );
+    }
+}
+
+/// Vertical pass: one strip of columns per iteration, filtered a row at a time.
+class RecursiveGaussianColsBody : public cv::ParallelLoopBody
+{
+public:
+    RecursiveGaussianColsBody( const cv::Mat& _src, cv::Mat& _buf, int _pad, int _strip,
+                               const RecursiveGaussianCoeffs& _k )
+        : src(_src), buf(_buf), pad(_pad), strip(_strip), k(_k) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols * src.channels();
+        int x0 = range.start * strip;
+        int x1 = std::min( range.end * strip, width );
+
+        for( int i = 0; i < buf.rows; i++ )
+        {
+            int y = cv::borderInterpolate( i - pad, src.rows, cv::BORDER_REFLECT_101 );
+            const uchar* s = src.ptr<uchar>(y);
+            float* d = buf.ptr<float>(i);
+            for( int x = x0; x < x1; x++ )
+            { d[x] = s[x]; }
+        }
+        recursiveGaussianLines( buf.ptr<float>(0) + x0, buf.step / sizeof(float),
+                buf.rows, x1 - x0, k );
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& buf;
+    int pad, strip;
+    RecursiveGaussianCoeffs k;
+};
+
+/// Horizontal pass: four rows at a time are interleaved into a transposed
+/// tile, filtered along what are now its columns, and written back as 8-bit.
+class RecursiveGaussianRowsBody : public cv::ParallelLoopBody
+{
+public:
+    RecursiveGaussianRowsBody( const cv::Mat& _buf, cv::Mat& _dst, int _pad, int _padX,
+                               const RecursiveGaussianCoeffs& _k )
+        : buf(_buf), dst(_dst), pad(_pad), padX(_padX), k(_k) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int cn = dst.channels();
+        int lanes = 4 * cn;
+        int n = dst.cols + 2 * padX;
+        std::vector<float> tile( (size_t)n * lanes );
+        std::vector<int> xofs( n );
+        for( int i = 0; i < n; i++ )
+        { xofs[i] = cv::borderInterpolate( i - padX, dst.cols, cv::BORDER_REFLECT_101 ) * cn; }
+
+        for( int g = range.start; g < range.end; g++ )
+        {
+            const float* rows[4];
+            for( int r = 0; r < 4; r++ )
+            { rows[r] = buf.ptr<float>( pad + std::min( g * 4 + r, dst.rows - 1 ) ); }
+
+            float* t = &tile[0];
+            for( int i = 0; i < n; i++, t += lanes )
+            {
+                for( int r = 0; r < 4; r++ )
+                {
+                    for( int c = 0; c < cn; c++ )
+                    { t[r * cn + c] = rows[r][xofs[i] + c]; }
+                }
+            }
+            recursiveGaussianLines( &tile[0], lanes, n, lanes, k );
+
+            for( int r = 0; r < 4 && g * 4 + r < dst.rows; r++ )
+            {
+                uchar* d = dst.ptr<uchar>( g * 4 + r );
+                const float* t = &tile[(size_t)padX * lanes + r * cn];
+                for( int x = 0; x < dst.cols; x++, t += lanes )
+                {
+                    for( int c = 0; c < cn; c++ )
+                    { d[x * cn + c] = cv::saturate_cast<uchar>( t[c] ); }
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& buf;
+    cv::Mat& dst;
+    int pad, padX;
+    RecursiveGaussianCoeffs k;
+};
+
+/// Gaussian blur of an 8-bit image with a cost per pixel that does not grow
+/// with sigma. Keeps its float intermediate between calls.
+class RecursiveGaussian
+{
+public:
+    void apply( const cv::Mat& src, cv::Mat& dst, double sigma )
+    {
+        CV_Assert( src.depth() == CV_8U );
+        RecursiveGaussianCoeffs k( sigma );
+        // Long enough a run-in for the reflected border to settle
+        int pad = cvCeil( 4 * std::max( sigma, 0.5 ) ) + 3;
+
+        int width = src.cols * src.channels();
+        buf.create( src.rows + 2 * pad, width, CV_32F );
+        int strip = std::max( 64, width / (cv::getNumThreads() * 4) );
+        strip = (strip + 3) & ~3;
+        cv::parallel_for_( cv::Range(0, (width + strip - 1) / strip),
+                RecursiveGaussianColsBody( src, buf, pad, strip, k ) );
+
+        dst.create( src.rows, src.cols, src.type() );
+        cv::parallel_for_( cv::Range(0, (src.rows + 3) / 4),
+                RecursiveGaussianRowsBody( buf, dst, pad, pad, k ) );
+    }
+
+private:
+    cv::Mat buf;
+};
+
+} // namespace tut
+
+#endif // TUTORIALS_RECURSIVE_GAUSSIAN_HPP
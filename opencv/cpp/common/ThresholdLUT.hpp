@@ -0,0 +1,115 @@
+// Threshold as a table lookup.
+
+// Every threshold type is a point operation: the output pixel depends on the
+// input pixel only, so for 8-bit images a (type, value) setting is fully
+// described by the 256 outputs it gives. ThresholdTables builds all of them
+// once, 5 types x 256 values x 256 entries = 320 KB, so moving a trackbar
+// costs a pointer lookup and the image is only read and written once.
+
+// A 256 entry byte table is a gather, which SSE2 cannot do, so applyTable
+// reads and writes 8 pixels per 64-bit word and splits the rows over threads.
+
+#ifndef TUTORIALS_THRESHOLD_LUT_HPP
+#define TUTORIALS_THRESHOLD_LUT_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <string.h>
+#include <vector>
+
+namespace tut
+{
+
+/// The table threshold( src, dst, value, maxval, type ) applies to 8-bit
+/// pixels, for the five basic types (THRESH_BINARY .. THRESH_TOZERO_INV).
+inline void buildThresholdTable( int type, int value, int maxval, uchar table[256] )
+{
+    CV_Assert( cv::THRESH_BINARY <= type && type <= cv::THRESH_TOZERO_INV );
+    uchar m = cv::saturate_cast<uchar>( maxval );
+    for( int i = 0; i < 256; i++ )
+    {
+        bool above = i > value;
+        switch( type )
+        {
+        case cv::THRESH_BINARY:     table[i] = above ? m : 0; break;
+        case cv::THRESH_BINARY_INV: table[i] = above ? 0 : m; break;
+        case cv::THRESH_TRUNC:      table[i] = (uchar)(above ? value : i); break;
+        case cv::THRESH_TOZERO:     table[i] = (uchar)(above ? i : 0); break;
+        default:  /* TOZERO_INV */  table[i] = (uchar)(above ? 0 : i); break;
+        }
+    }
+}
+
+/// Tables for every type and every threshold value 0..255, for one maxval.
+class ThresholdTables
+{
+public:
+    enum { TYPES = 5 };
+
+    explicit ThresholdTables( int maxval = 255 ) : tables( (size_t)TYPES * 256 * 256 )
+    {
+        for( int type = 0; type < TYPES; type++ )
+        {
+            for( int value = 0; value < 256; value++ )
+            { buildThresholdTable( type, value, maxval, &tables[((size_t)type * 256 + value) * 256] ); }
+        }
+    }
+
+    const uchar* get( int type, int value ) const
+    {
+        CV_Assert( 0 <= type && type < TYPES && 0 <= value && value < 256 );
+        return &tables[((size_t)type * 256 + value) * 256];
+    }
+
+private:
+    std::vector<uchar> tables;
+};
+
+class ApplyTableBody : public cv::ParallelLoopBody
+{
+public:
+    ApplyTableBody( const cv::Mat& _src, cv::Mat& _dst, const uchar* _table )
+        : src(_src), dst(_dst), table(_table) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        const uchar* t = table;
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            uchar* d = dst.ptr<uchar>(y);
+            int x = 0, width = src.cols * src.channels();
+            for( ; x <= width - 8; x += 8 )
+            {
+                uint64 v, r;
+                memcpy( &v, s + x, 8 );
+                r = (uint64)t[v & 255] | ((uint64)t[(v >> 8) & 255] << 8) |
+                    ((uint64)t[(v >> 16) & 255] << 16) | ((uint64)t[(v >> 24) & 255] << 24) |
+                    ((uint64)t[(v >> 32) & 255] << 32) | ((uint64)t[(v >> 40) & 255] << 40) |
+                    ((uint64)t[(v >> 48) & 255] << 48) | ((uint64)t[v >> 56] << 56);
+                memcpy( d + x, &r, 8 );
+            }
+            for( ; x < width; x++ )
+            { d[x] = t[s[x]]; }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    cv::Mat& dst;
+    const uchar* table;
+};
+
+/// dst(x, y) = table[src(x, y)] for 8-bit images, in parallel over rows.
+inline void applyTable( const cv::Mat& src, cv::Mat& dst, const uchar* table )
+{
+    CV_Assert( src.depth() == CV_8U );
+    dst.create( src.size(), src.type() );
+    cv::parallel_for_( cv::Range(0, src.rows), ApplyTableBody( src, dst, table ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_THRESHOLD_LUT_HPP
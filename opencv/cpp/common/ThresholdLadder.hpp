@@ -0,0 +1,138 @@
+// Every threshold type, at several threshold values, in one read of the image.
+
+// Looking at the five threshold types at a few values each normally means
+// one threshold call, and one full pass over the source, per output. Here
+// 16 pixels are loaded once and, for every value, one SSE2 compare gives the
+// mask all five types are made from:
+//   BINARY      mask & maxval          BINARY_INV  ~mask & maxval
+//   TRUNC       min( src, value )
+//   TOZERO      mask & src             TOZERO_INV  ~mask & src
+// The source is then read once however many outputs are asked for; only the
+// writes grow with their number.
+
+#ifndef TUTORIALS_THRESHOLD_LADDER_HPP
+#define TUTORIALS_THRESHOLD_LADDER_HPP
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/core/utility.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include <vector>
+
+#if CV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace tut
+{
+
+/// type_mask selecting all five types; type t alone is 1 << t.
+static const int THRESH_ALL_TYPES = 31;
+
+class ThresholdLadderBody : public cv::ParallelLoopBody
+{
+public:
+    ThresholdLadderBody( const cv::Mat& _src, const std::vector<int>& _values,
+                         const std::vector<int>& _types, uchar _maxval, std::vector<cv::Mat>& _dst )
+        : src(_src), values(_values), types(_types), maxval(_maxval), dst(_dst) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int nv = (int)values.size(), nt = (int)types.size();
+        std::vector<uchar*> d( dst.size() );
+        for( int y = range.start; y < range.end; y++ )
+        {
+            const uchar* s = src.ptr<uchar>(y);
+            for( size_t i = 0; i < dst.size(); i++ ) { d[i] = dst[i].ptr<uchar>(y); }
+
+            int x = 0;
+#if CV_SSE2
+            __m128i bias = _mm_set1_epi8( (char)0x80 );
+            __m128i m = _mm_set1_epi8( (char)maxval );
+            for( ; x <= src.cols - 16; x += 16 )
+            {
+                __m128i v = _mm_loadu_si128( (const __m128i*)(s + x) );
+                __m128i vb = _mm_xor_si128( v, bias );
+                for( int j = 0; j < nv; j++ )
+                {
+                    // Below 0 every pixel is above the value; from 255 up the
+                    // compare against 255 already finds none
+                    __m128i t = _mm_set1_epi8( (char)cv::saturate_cast<uchar>( values[j] ) );
+                    __m128i above = values[j] < 0 ? _mm_set1_epi8( (char)0xff )
+                                                  : _mm_cmpgt_epi8( vb, _mm_xor_si128( t, bias ) );
+                    for( int i = 0; i < nt; i++ )
+                    {
+                        __m128i r;
+                        switch( types[i] )
+                        {
+                        case cv::THRESH_BINARY:     r = _mm_and_si128( above, m ); break;
+                        case cv::THRESH_BINARY_INV: r = _mm_andnot_si128( above, m ); break;
+                        case cv::THRESH_TRUNC:      r = _mm_min_epu8( v, t ); break;
+                        case cv::THRESH_TOZERO:     r = _mm_and_si128( above, v ); break;
+                        default:                    r = _mm_andnot_si128( above, v ); break;
+                        }
+                        _mm_storeu_si128( (__m128i*)(d[j * nt + i] + x), r );
+                    }
+                }
+            }
+#endif
+            for( ; x < src.cols; x++ )
+            {
+                int v = s[x];
+                for( int j = 0; j < nv; j++ )
+                {
+                    int t = cv::saturate_cast<uchar>( values[j] );
+                    bool above = v > values[j];
+                    for( int i = 0; i < nt; i++ )
+                    {
+                        uchar r;
+                        switch( types[i] )
+                        {
+                        case cv::THRESH_BINARY:     r = above ? maxval : 0; break;
+                        case cv::THRESH_BINARY_INV: r = above ? 0 : maxval; break;
+                        case cv::THRESH_TRUNC:      r = (uchar)(above ? t : v); break;
+                        case cv::THRESH_TOZERO:     r = (uchar)(above ? v : 0); break;
+                        default:                    r = (uchar)(above ? 0 : v); break;
+                        }
+                        d[j * nt + i][x] = r;
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& src;
+    const std::vector<int>& values;
+    const std::vector<int>& types;
+    uchar maxval;
+    std::vector<cv::Mat>& dst;
+};
+
+/// threshold( src, dst[j * n + i], values[j], maxval, type_i ) for every
+/// value j and every type i selected in type_mask (in increasing type order,
+/// n of them), all in one pass over an 8-bit single channel src.
+/// As with threshold(), a value below 0 has every pixel above it and one
+/// from 255 up has none.
+inline void thresholdLadder( const cv::Mat& src, const std::vector<int>& values, int maxval,
+                             int type_mask, std::vector<cv::Mat>& dst )
+{
+    CV_Assert( src.type() == CV_8UC1 && !values.empty() );
+    CV_Assert( (type_mask & THRESH_ALL_TYPES) != 0 && (type_mask & ~THRESH_ALL_TYPES) == 0 );
+
+    std::vector<int> types;
+    for( int type = cv::THRESH_BINARY; type <= cv::THRESH_TOZERO_INV; type++ )
+    {
+        if( type_mask & (1 << type) ) { types.push_back( type ); }
+    }
+    dst.resize( values.size() * types.size() );
+    for( size_t i = 0; i < dst.size(); i++ )
+    { dst[i].create( src.rows, src.cols, CV_8UC1 ); }
+
+    cv::parallel_for_( cv::Range(0, src.rows),
+            ThresholdLadderBody( src, values, types, cv::saturate_cast<uchar>( maxval ), dst ),
+            std::max( 1, src.rows / 32 ) );
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_THRESHOLD_LADDER_HPP
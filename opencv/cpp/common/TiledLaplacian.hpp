@@ -0,0 +1,226 @@
+// Tiled, fused version of the Laplacian tutorial pipeline:
+//   gray -> 3x3 Gaussian blur -> Laplacian -> |.| saturated to 8 bits
+
+// The tutorial runs GaussianBlur, cvtColor, Laplacian and convertScaleAbs one
+// after the other, each streaming the whole frame through memory, with a
+// full size CV_16S image in the middle. Here the image is cut into bands of
+// rows, and all four steps run on one band before moving to the next, so the
+// band and the few halo rows above and below it stay in L2. Bands are
+// processed in parallel.
+
+// Two things differ from the tutorial on purpose:
+//   - color is converted to gray first, so only one channel is blurred
+//     (blur and gray conversion are both linear, so only rounding changes)
+//   - the Laplacian goes straight to 8-bit |value|, no CV_16S image is made
+
+#ifndef TUTORIALS_TILED_LAPLACIAN_HPP
+#define TUTORIALS_TILED_LAPLACIAN_HPP
+
+#include "DerivativeOps.hpp"
+
+namespace tut
+{
+
+/// BGR to gray with the fixed point weights cvtColor uses for 8-bit images.
+inline void grayRow( const uchar* s, uchar* d, int width, int cn )
+{
+    if( cn == 1 )
+    {
+        memcpy( d, s, width );
+        return;
+    }
+    for( int x = 0; x < width; x++, s += cn )
+    { d[x] = (uchar)((s[0] * 1868 + s[1] * 9617 + s[2] * 4899 + (1 << 13)) >> 14); }
+}
+
+template<class X1, class Y1, class X2, class Y2>
+class TiledLaplacianBody : public cv::ParallelLoopBody
+{
+public:
+    enum { K = X1::size, R = X1::size / 2, P = R + 1 };
+
+    TiledLaplacianBody( const cv::Mat& _src, cv::Mat& _dst, int _tile_rows )
+        : src(_src), dst(_dst), tile_rows(_tile_rows) {}
+
+    void operator()( const cv::Range& range ) const
+    {
+        int width = src.cols, cn = src.channels();
+        int gw = width + 2 * P;     // gray and vertically blurred rows
+        int bw = width + 2 * R;     // blurred rows
+        int max_blurred = tile_rows + 2 * R;
+
+        // Per thread band buffers, reused for every band of the range
+        std::vector<uchar> gray_row( width );
+        std::vector<uchar> gray( (size_t)(max_blurred + 2) * gw );
+        std::vector<short> vsum( gw );
+        std::vector<uchar> blurred( (size_t)max_blurred * bw + 8 );
+        std::vector<short> h1( (size_t)max_blurred * width ), h2( h1.size() );
+        std::vector<int> xofs( 2 * P );
+        for( int i = 0; i < P; i++ )
+        {
+            xofs[i] = cv::borderInterpolate( i - P, width, cv::BORDER_REFLECT_101 );
+            xofs[P + i] = cv::borderInterpolate( width + i, width, cv::BORDER_REFLECT_101 );
+        }
+
+        for( int t = range.start; t < range.end; t++ )
+        {
+            int y0 = t * tile_rows;
+            int y1 = std::min( y0 + tile_rows, src.rows );
+            int nb = y1 - y0 + 2 * R;
+
+            // 1. Gray rows y0-R-1 .. y1+R, reflected at the image edges
+            for( int i = 0; i < nb + 2; i++ )
+            {
+                int y = cv::borderInterpolate( y0 - R - 1 + i, src.rows, cv::BORDER_REFLECT_101 );
+                uchar* g = &gray[(size_t)i * gw];
+                grayRow( src.ptr<uchar>(y), g + P, width, cn );
+                for( int k = 0; k < P; k++ )
+                {
+                    g[k] = g[P + xofs[k]];
+                    g[P + width + k] = g[P + xofs[P + k]];
+                }
+            }
+
+            // 2. 3x3 Gaussian, [1 2 1] / 4 each way, rows y0-R .. y1+R-1
+            for( int j = 0; j < nb; j++ )
+            { blurRow( &gray[(size_t)j * gw], gw, &vsum[0], &blurred[(size_t)j * bw], bw ); }
+
+            // 3. Horizontal taps of both Laplacian terms
+            for( int j = 0; j < nb; j++ )
+            {
+                const uchar* b = &blurred[(size_t)j * bw];
+                horizontal<X1>( b, &h1[(size_t)j * width], width );
+                horizontal<X2>( b, &h2[(size_t)j * width], width );
+            }
+
+            // 4. Vertical taps, |.| and saturation to 8 bits
+            for( int y = y0; y < y1; y++ )
+            {
+                const short* rows1[K];
+                const short* rows2[K];
+                for( int k = 0; k < K; k++ )
+                {
+                    rows1[k] = &h1[(size_t)(y - y0 + k) * width];
+                    rows2[k] = &h2[(size_t)(y - y0 + k) * width];
+                }
+                uchar* d = dst.ptr<uchar>(y);
+                int x = 0;
+#if CV_SSE2
+                __m128i z = _mm_setzero_si128();
+                for( ; x <= width - 8; x += 8 )
+                {
+                    __m128i lo = z, hi = z;
+                    VerticalInput8 in1 = { rows1, x }, in2 = { rows2, x };
+                    TapsOf<Y1>::Dot::sse32( in1, lo, hi );
+                    TapsOf<Y2>::Dot::sse32( in2, lo, hi );
+                    __m128i v = _mm_packs_epi32( lo, hi );
+                    v = _mm_max_epi16( v, _mm_sub_epi16( z, v ) );
+                    _mm_storel_epi64( (__m128i*)(d + x), _mm_packus_epi16( v, v ) );
+                }
+#endif
+                for( ; x < width; x++ )
+                {
+                    VerticalInput in1 = { rows1, x }, in2 = { rows2, x };
+                    int v = TapsOf<Y1>::Dot::scalar( in1 ) + TapsOf<Y2>::Dot::scalar( in2 );
+                    d[x] = cv::saturate_cast<uchar>( std::abs( v ) );
+                }
+            }
+        }
+    }
+
+private:
+    /// Blurred row from three gray rows starting at g: vertical [1 2 1] into
+    /// vsum, then horizontal [1 2 1], rounded (s + 8) >> 4.
+    static void blurRow( const uchar* g, int gw, short* vsum, uchar* b, int bw )
+    {
+        const uchar* g0 = g;
+        const uchar* g1 = g + gw;
+        const uchar* g2 = g + 2 * gw;
+        int x = 0;
+#if CV_SSE2
+        __m128i z = _mm_setzero_si128();
+        for( ; x <= gw - 8; x += 8 )
+        {
+            __m128i a = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(g0 + x) ), z );
+            __m128i m = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(g1 + x) ), z );
+            __m128i c = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*)(g2 + x) ), z );
+            _mm_storeu_si128( (__m128i*)(vsum + x), _mm_add_epi16( _mm_add_epi16( a, c ), _mm_add_epi16( m, m ) ) );
+        }
+#endif
+        for( ; x < gw; x++ )
+        { vsum[x] = (short)(g0[x] + 2 * g1[x] + g2[x]); }
+
+        x = 0;
+#if CV_SSE2
+        __m128i eight = _mm_set1_epi16( 8 );
+        for( ; x <= bw - 8; x += 8 )
+        {
+            __m128i l = _mm_loadu_si128( (const __m128i*)(vsum + x) );
+            __m128i m = _mm_loadu_si128( (const __m128i*)(vsum + x + 1) );
+            __m128i r = _mm_loadu_si128( (const __m128i*)(vsum + x + 2) );
+            __m128i s = _mm_add_epi16( _mm_add_epi16( l, r ), _mm_add_epi16( m, m ) );
+            s = _mm_srli_epi16( _mm_add_epi16( s, eight ), 4 );
+            _mm_storel_epi64( (__m128i*)(b + x), _mm_packus_epi16( s, s ) );
+        }
+#endif
+        for( ; x < bw; x++ )
+        { b[x] = (uchar)((vsum[x] + 2 * vsum[x + 1] + vsum[x + 2] + 8) >> 4); }
+    }
+
+    template<class X> static void horizontal( const uchar* p, short* h, int width )
+    {
+        int x = 0;
+#if CV_SSE2
+        for( ; x <= width - 8; x += 8 )
+        {
+            HorizontalInput8 in = { p + x };
+            _mm_storeu_si128( (__m128i*)(h + x), TapsOf<X>::Dot::sse16( in, _mm_setzero_si128() ) );
+        }
+#endif
+        for( ; x < width; x++ )
+        {
+            HorizontalInput in = { p + x };
+            h[x] = (short)TapsOf<X>::Dot::scalar( in );
+        }
+    }
+
+    const cv::Mat& src;
+    cv::Mat& dst;
+    int tile_rows;
+};
+
+template<class X1, class Y1, class X2, class Y2>
+void runTiledLaplacian( const cv::Mat& src, cv::Mat& dst, int tile_rows )
+{
+    cv::parallel_for_( cv::Range(0, (src.rows + tile_rows - 1) / tile_rows),
+            TiledLaplacianBody<X1, Y1, X2, Y2>( src, dst, tile_rows ) );
+}
+
+/// Edge strength of a BGR (or gray) 8-bit image in one tiled pass, the
+/// equivalent of
+///   cvtColor( src, gray, COLOR_BGR2GRAY ); GaussianBlur( gray, gray, Size(3,3), 0 );
+///   Laplacian( gray, lap, CV_16S, ksize ); convertScaleAbs( lap, dst );
+/// ksize is 1, 3 or 5. tile_rows 0 picks bands of about 256 KB of buffers.
+inline void tiledLaplacianEdges( const cv::Mat& src, cv::Mat& dst, int ksize = 3, int tile_rows = 0 )
+{
+    CV_Assert( src.depth() == CV_8U && (src.channels() == 1 || src.channels() == 3) );
+    CV_Assert( src.data != dst.data );
+    if( tile_rows <= 0 )
+    {
+        // gray + blurred + two int16 terms, about 6 bytes per pixel of a band
+        tile_rows = std::min( std::max( (256 << 10) / (6 * std::max( src.cols, 1 )), 8 ), 128 );
+    }
+    dst.create( src.rows, src.cols, CV_8UC1 );
+
+    switch( ksize )
+    {
+    case 1: runTiledLaplacian<SecondDeriv3, Identity3, Identity3, SecondDeriv3>( src, dst, tile_rows ); break;
+    case 3: runTiledLaplacian<SecondDeriv3, Smooth3, Smooth3, SecondDeriv3>( src, dst, tile_rows ); break;
+    case 5: runTiledLaplacian<SecondDeriv5, Smooth5, Smooth5, SecondDeriv5>( src, dst, tile_rows ); break;
+    default: CV_Assert( ksize == 1 || ksize == 3 || ksize == 5 );
+    }
+}
+
+} // namespace tut
+
+#endif // TUTORIALS_TILED_LAPLACIAN_HPP